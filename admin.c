@@ -219,6 +219,10 @@ static void __nvmev_admin_get_log_page(int eid)
 				[nvme_admin_get_features] = cpu_to_le32(NVME_CMD_EFFECTS_CSUPP),
 				[nvme_admin_async_event] = cpu_to_le32(NVME_CMD_EFFECTS_CSUPP),
 				// [nvme_admin_keep_alive] = cpu_to_le32(NVME_CMD_EFFECTS_CSUPP),
+#if SUPPORTED_SSD_TYPE(CONV)
+				[nvme_admin_filter_table] = cpu_to_le32(NVME_CMD_EFFECTS_CSUPP),
+				[nvme_admin_filter_bloom] = cpu_to_le32(NVME_CMD_EFFECTS_CSUPP),
+#endif
 			},
 			.iocs = {
 #if SUPPORTED_SSD_TYPE(ZNS)
@@ -239,6 +243,21 @@ static void __nvmev_admin_get_log_page(int eid)
 		__memcpy(page, &effects_log, len);
 		break;
 	}
+#if SUPPORTED_SSD_TYPE(CONV)
+	case NVME_LOG_FILTER_TABLES: {
+		struct nvme_filter_table_log *log = kmalloc(sizeof(*log), GFP_KERNEL);
+
+		if (!log) {
+			__make_cq_entry(eid, NVME_SC_INTERNAL);
+			return;
+		}
+
+		filter_table_log(log);
+		__memcpy(page, log, min_t(uint32_t, len, sizeof(*log)));
+		kfree(log);
+		break;
+	}
+#endif
 	default:
 		/*
 		 * The NVMe protocol mandates several commands (lid) to be implemented, but some
@@ -553,6 +572,56 @@ static void __nvmev_admin_get_features(int eid)
 }
 
 
+/***
+ * Filter table catalog and Bloom filters
+ */
+#if SUPPORTED_SSD_TYPE(CONV)
+static void __nvmev_admin_filter_table(int eid)
+{
+	struct nvmev_admin_queue *queue = nvmev_vdev->admin_q;
+	struct nvme_common_command *cmd = &sq_entry(eid).common;
+	uint32_t id = 0, status;
+
+	switch (cmd->cdw10[0]) {
+	case NVME_FILTER_TABLE_REGISTER:
+		status = filter_table_register(cmd->nsid, cmd->prp1, cmd->prp2, &id);
+		break;
+	case NVME_FILTER_TABLE_UNREGISTER:
+		id = cmd->cdw10[1];
+		status = filter_table_unregister(id);
+		break;
+	default:
+		status = NVME_SC_INVALID_FIELD;
+		break;
+	}
+
+	__make_cq_entry_results(eid, status, id, 0);
+}
+
+static void __nvmev_admin_filter_bloom(int eid)
+{
+	struct nvmev_admin_queue *queue = nvmev_vdev->admin_q;
+	struct nvme_common_command *cmd = &sq_entry(eid).common;
+	uint32_t id = 0, status;
+
+	switch (cmd->cdw10[0]) {
+	case NVME_FILTER_BLOOM_LOAD:
+		status = filter_bloom_load(cmd->prp1, cmd->prp2, &id);
+		break;
+	case NVME_FILTER_BLOOM_DROP:
+		id = cmd->cdw10[1];
+		status = filter_bloom_drop(id);
+		break;
+	default:
+		status = NVME_SC_INVALID_FIELD;
+		break;
+	}
+
+	__make_cq_entry_results(eid, status, id, 0);
+}
+#endif
+
+
 /***
  * Misc
  */
@@ -601,6 +670,14 @@ static void __nvmev_proc_admin_req(int entry_id)
 	case nvme_admin_async_event:
 		__nvmev_admin_async_event(entry_id);
 		break;
+#if SUPPORTED_SSD_TYPE(CONV)
+	case nvme_admin_filter_table:
+		__nvmev_admin_filter_table(entry_id);
+		break;
+	case nvme_admin_filter_bloom:
+		__nvmev_admin_filter_bloom(entry_id);
+		break;
+#endif
 	case nvme_admin_activate_fw:
 	case nvme_admin_download_fw:
 	case nvme_admin_format_nvm:
@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <linux/slab.h>
+
+#include "nvmev.h"
+#include "compute_model.h"
+
+void cmodel_init(struct compute_model *cm, uint32_t nr_cores, uint64_t freq /*MHz*/)
+{
+	cm->nr_cores = nr_cores;
+	cm->freq = freq;
+	cm->next_core_avail_time = kcalloc(nr_cores, sizeof(uint64_t), GFP_KERNEL);
+
+	NVMEV_INFO("[%s] cores %u freq %llu MHz\n", __func__, nr_cores, freq);
+}
+
+void cmodel_remove(struct compute_model *cm)
+{
+	kfree(cm->next_core_avail_time);
+	cm->next_core_avail_time = NULL;
+}
+
+uint64_t cmodel_request(struct compute_model *cm, uint64_t request_time, uint64_t cycles)
+{
+	uint32_t i, core = 0;
+	uint64_t stime;
+
+	if (cycles == 0)
+		return request_time;
+
+	/* pick the core that becomes idle first */
+	for (i = 1; i < cm->nr_cores; i++) {
+		if (cm->next_core_avail_time[i] < cm->next_core_avail_time[core])
+			core = i;
+	}
+
+	stime = max(request_time, cm->next_core_avail_time[core]);
+	cm->next_core_avail_time[core] = stime + CYCLES_TO_NS(cycles, cm->freq);
+
+	return cm->next_core_avail_time[core];
+}
@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef _COMPUTE_MODEL_H
+#define _COMPUTE_MODEL_H
+
+/*
+ * Embedded controller cores running in-storage processing. A request is a
+ * batch of work that runs to completion on whichever core frees up first.
+ */
+struct compute_model {
+	uint32_t nr_cores;
+	uint64_t freq; /* MHz */
+	uint64_t *next_core_avail_time;
+};
+
+#define CYCLES_TO_NS(cycles, MHZ) DIV_ROUND_UP((cycles) * 1000ULL, (MHZ))
+
+uint64_t cmodel_request(struct compute_model *cm, uint64_t request_time, uint64_t cycles);
+void cmodel_init(struct compute_model *cm, uint32_t nr_cores, uint64_t freq /*MHz*/);
+void cmodel_remove(struct compute_model *cm);
+#endif
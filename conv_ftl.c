@@ -5,6 +5,7 @@
 
 #include "nvmev.h"
 #include "conv_ftl.h"
+#include "filter.h"
 
 static inline bool last_pg_in_wordline(struct conv_ftl *conv_ftl, struct ppa *ppa)
 {
@@ -393,16 +394,25 @@ void conv_init_namespace(struct nvmev_ns *ns, uint32_t id, uint64_t size, void *
 		conv_init_ftl(&conv_ftls[i], &cpp, ssd);
 	}
 
-	/* PCIe, Write buffer are shared by all instances*/
+	/* PCIe, Write buffer, controller cores are shared by all instances*/
 	for (i = 1; i < nr_parts; i++) {
 		kfree(conv_ftls[i].ssd->pcie->perf_model);
 		kfree(conv_ftls[i].ssd->pcie);
 		kfree(conv_ftls[i].ssd->write_buffer);
+		cmodel_remove(conv_ftls[i].ssd->compute);
+		kfree(conv_ftls[i].ssd->compute);
 
 		conv_ftls[i].ssd->pcie = conv_ftls[0].ssd->pcie;
 		conv_ftls[i].ssd->write_buffer = conv_ftls[0].ssd->write_buffer;
+		conv_ftls[i].ssd->compute = conv_ftls[0].ssd->compute;
 	}
 
+	/* Filter commands are processed one at a time with the memory of the first instance */
+	filter_arena_init(&conv_ftls[0].filter_arena, FILTER_ARENA_SIZE);
+	filter_zonemap_init(&conv_ftls[0].filter_zonemap, spp.tt_pgs * nr_parts, spp.pgsz);
+	filter_shared_init(&conv_ftls[0].filter_shared, FILTER_MAX_SCAN_SIZE / spp.pgsz + 1);
+	filter_select_kernels();
+
 	ns->id = id;
 	ns->csi = NVME_CSI_NVM;
 	ns->nr_parts = nr_parts;
@@ -424,7 +434,7 @@ void conv_remove_namespace(struct nvmev_ns *ns)
 	const uint32_t nr_parts = SSD_PARTITIONS;
 	uint32_t i;
 
-	/* PCIe, Write buffer are shared by all instances*/
+	/* PCIe, Write buffer, controller cores are shared by all instances*/
 	for (i = 1; i < nr_parts; i++) {
 		/*
 		 * These were freed from conv_init_namespace() already.
@@ -432,8 +442,14 @@ void conv_remove_namespace(struct nvmev_ns *ns)
 		 */
 		conv_ftls[i].ssd->pcie = NULL;
 		conv_ftls[i].ssd->write_buffer = NULL;
+		conv_ftls[i].ssd->compute = NULL;
 	}
 
+	filter_arena_exit(&conv_ftls[0].filter_arena);
+	filter_zonemap_exit(&conv_ftls[0].filter_zonemap);
+	filter_shared_exit(&conv_ftls[0].filter_shared);
+	filter_blooms_exit();
+
 	for (i = 0; i < nr_parts; i++) {
 		conv_remove_ftl(&conv_ftls[i]);
 		ssd_remove(conv_ftls[i].ssd);
@@ -962,6 +978,42 @@ static bool conv_read(struct nvmev_ns *ns, struct nvmev_request *req, struct nvm
 	return true;
 }
 
+/* Process pages sensed at @nsecs_sensed on a controller core, then ship their results */
+static uint64_t __filter_eval(struct conv_ftl *conv_ftl, uint64_t nsecs_sensed, uint64_t out_size,
+			      uint64_t cycles)
+{
+	uint64_t nsecs_completed = ssd_advance_compute(conv_ftl->ssd, nsecs_sensed, cycles);
+
+	if (out_size > 0)
+		nsecs_completed = ssd_advance_pcie(conv_ftl->ssd, nsecs_completed, out_size);
+
+	return nsecs_completed;
+}
+
+/*
+ * Sense and transfer a flash page batch, process it on a controller core,
+ * then ship its results to the host. @nsecs_sensed is when it was sensed.
+ */
+static uint64_t __filter_advance(struct conv_ftl *conv_ftl, struct nand_cmd *srd,
+				 uint64_t out_size, uint64_t cycles, uint64_t *nsecs_sensed)
+{
+	*nsecs_sensed = ssd_advance_nand(conv_ftl->ssd, srd);
+
+	return __filter_eval(conv_ftl, *nsecs_sensed, out_size, cycles);
+}
+
+/* The pages of a batch, pending in @sensed from @first to @end every @step, were sensed */
+static void __filter_sensed(uint64_t *sensed, uint64_t first, uint64_t end, uint32_t step,
+			    uint64_t nsecs)
+{
+	uint64_t i;
+
+	for (i = first; sensed && i < end; i += step) {
+		if (sensed[i] == U64_MAX)
+			sensed[i] = nsecs;
+	}
+}
+
 static bool conv_filter(struct nvmev_ns *ns, struct nvmev_request *req, struct nvmev_result *ret)
 {
 	// 初始化FTL相关结构
@@ -982,6 +1034,7 @@ static bool conv_filter(struct nvmev_ns *ns, struct nvmev_request *req, struct n
 	uint64_t start_lpn = lba / spp->secs_per_pg;
 	// 结束逻辑页号
 	uint64_t end_lpn = (lba + nr_lba - 1) / spp->secs_per_pg;
+	uint64_t slpn = start_lpn;
 	uint64_t lpn;
 	// 请求开始时间
 	uint64_t nsecs_start = req->nsecs_start;
@@ -992,29 +1045,73 @@ static bool conv_filter(struct nvmev_ns *ns, struct nvmev_request *req, struct n
 	// 存储分区数量，即die/lun（并行通道数）
 	uint32_t nr_parts = ns->nr_parts;
 
+	struct filter_zonemap *zm = &conv_ftls[0].filter_zonemap;
+	struct filter_shared *shared = &conv_ftls[0].filter_shared;
+	struct filter_ctx *ctx = &conv_ftls[0].filter_ctx;
+	uint64_t out_size, cycles;
+	uint64_t *sensed, nsecs_sensed, batch_lpn;
+	uint32_t status;
+	bool prune;
+
 	struct ppa prev_ppa;
 	struct nand_cmd srd = {
 		.type = USER_IO,
-		.amp_factor = cmd->filter.filter_factor,
+		.amp_factor = 100,
 		.cmd = NAND_READ,
 		.stime = nsecs_start,
-		.interleave_pci_dma = true, // 启用PCIe交错传输
+		/* matching records leave the device only after being evaluated */
+		.interleave_pci_dma = false,
 	};
 
-	/*----- 预检阶段 -----*/
 	NVMEV_ASSERT(conv_ftls);
+
+	/*
+	 * Evaluate the predicate on the stored records and hand only the
+	 * matching ones to the host. The bytes returned per logical page
+	 * decide how much each flash page batch costs on PCIe.
+	 */
+	status = filter_ctx_init(ctx, &cmd->filter, &conv_ftls[0].filter_desc,
+				 &conv_ftls[0].filter_arena, spp->pgsz, ns->size);
+	if (status != NVME_SC_SUCCESS) {
+		filter_ctx_free(ctx);
+		ret->nsecs_target = nsecs_start;
+		ret->status = status;
+		return true;
+	}
+
+	/* a streaming command scans part of an extent rather than its LBA range */
+	nr_lba = BYTE_TO_LBA(ctx->scan_len);
+	start_lpn = ctx->scan_offs / spp->pgsz;
+	end_lpn = (ctx->scan_offs + ctx->scan_len - 1) / spp->pgsz;
+	slpn = start_lpn;
+
+	/*----- 预检阶段 -----*/
 	NVMEV_DEBUG_VERBOSE("%s: start_lpn=%lld, len=%lld, end_lpn=%lld", __func__, start_lpn,
 			    nr_lba, end_lpn);
 	// 检查LPN是否超出FTL管理范围
-	if ((end_lpn / nr_parts) >= spp->tt_pgs) {
+	if ((end_lpn / nr_parts) >= spp->tt_pgs || ctx->scan_offs + ctx->scan_len > ns->size) {
 		NVMEV_ERROR("%s: lpn passed FTL range (start_lpn=%lld > tt_pgs=%ld)\n", __func__,
 			    start_lpn, spp->tt_pgs);
-		return false;
+		filter_ctx_free(ctx);
+		/* completing it, as retrying would fail forever */
+		ret->nsecs_target = nsecs_start;
+		ret->status = NVME_SC_LBA_RANGE;
+		return true;
 	}
 
+	filter_scan(ctx, ns->mapped + ctx->scan_offs, ctx->scan_len);
+	status = filter_finish(ctx);
+
+	/* nothing past the cursor has been read */
+	if (ctx->stream && ctx->cursor != NVME_FILTER_CURSOR_DONE)
+		end_lpn = min(end_lpn, (ctx->extent_offs + ctx->cursor) / spp->pgsz);
+
+	/* pages the zone maps rule out are never read from NAND */
+	prune = filter_zonemap_applies(zm, ctx, ctx->scan_offs);
+
 	 /*----- 延迟计算 -----*/
 	 // 根据请求大小选择基础延迟
-	if (LBA_TO_BYTE(nr_lba) <= (KB(4) * nr_parts)) {
+	if (ctx->scan_len <= (KB(4) * nr_parts)) {
 		// 小IO优化延迟（4KB对齐）
 		srd.stime += spp->fw_4kb_rd_lat;
 	} else {
@@ -1022,13 +1119,19 @@ static bool conv_filter(struct nvmev_ns *ns, struct nvmev_request *req, struct n
 		srd.stime += spp->fw_rd_lat;
 	}
 
+	/* when each page is sensed, for later commands to attach to this scan */
+	sensed = filter_shared_begin(shared, ctx->nr_units);
+
 	/*----- 主处理循环 -----*/
 	for (i = 0; (i < nr_parts) && (start_lpn <= end_lpn); i++, start_lpn++) {
 		// 轮询选择FTL实例，即交错传输
 		conv_ftl = &conv_ftls[start_lpn % nr_parts];
 		xfer_size = 0;
+		out_size = 0;
+		cycles = 0;
 		// 初始PPA获取，用于聚合
 		prev_ppa = get_maptbl_ent(conv_ftl, start_lpn / nr_parts);
+		batch_lpn = start_lpn;
 
 		/* normal IO read path */
 		/* 逻辑页遍历 */
@@ -1036,6 +1139,13 @@ static bool conv_filter(struct nvmev_ns *ns, struct nvmev_request *req, struct n
 			uint64_t local_lpn;
 			struct ppa cur_ppa;
 			
+			if (prune && !filter_zonemap_may_match(zm, &ctx->prog, lpn))
+				continue;
+
+			/* nor are the pages out of a page sample */
+			if (ctx->units[lpn - slpn].unsampled)
+				continue;
+
 			// 获取物理页地址
 			local_lpn = lpn / nr_parts;
 			cur_ppa = get_maptbl_ent(conv_ftl, local_lpn);
@@ -1050,11 +1160,27 @@ static bool conv_filter(struct nvmev_ns *ns, struct nvmev_request *req, struct n
 				continue;
 			}
 
+			/* a scan in progress sensing the page later on evaluates it for us too */
+			nsecs_sensed = sensed ? filter_shared_sensed(shared, lpn, srd.stime) : 0;
+			if (nsecs_sensed) {
+				sensed[lpn - slpn] = nsecs_sensed;
+				nsecs_completed = __filter_eval(conv_ftl, nsecs_sensed,
+								ctx->units[lpn - slpn].out_bytes,
+								ctx->units[lpn - slpn].cycles);
+				nsecs_latest = max(nsecs_completed, nsecs_latest);
+				continue;
+			}
+
+			if (sensed)
+				sensed[lpn - slpn] = U64_MAX;
+
 			// aggregate read io in same flash page
 			/* IO聚合逻辑 */
 			if (mapped_ppa(&prev_ppa) &&
 			    is_same_flash_page(conv_ftl, cur_ppa, prev_ppa)) {
 				xfer_size += spp->pgsz;
+				out_size += ctx->units[lpn - slpn].out_bytes;
+				cycles += ctx->units[lpn - slpn].cycles;
 				continue;
 			}
 
@@ -1064,30 +1190,51 @@ static bool conv_filter(struct nvmev_ns *ns, struct nvmev_request *req, struct n
 				srd.xfer_size = xfer_size;
 				// 指定物理地址
 				srd.ppa = &prev_ppa;
-				// 模拟NAND操作
-				nsecs_completed = ssd_advance_nand(conv_ftl->ssd, &srd);
+				// 模拟NAND操作及结果回传
+				nsecs_completed = __filter_advance(conv_ftl, &srd, out_size, cycles,
+								   &nsecs_sensed);
 				// 更新时间戳
 				nsecs_latest = max(nsecs_completed, nsecs_latest);
+				__filter_sensed(sensed, batch_lpn - slpn, lpn - slpn, nr_parts,
+						nsecs_sensed);
 			}
 
 			// 重置传输量
 			xfer_size = spp->pgsz;
+			out_size = ctx->units[lpn - slpn].out_bytes;
+			cycles = ctx->units[lpn - slpn].cycles;
 			// 更新prev_ppa
 			prev_ppa = cur_ppa;
+			batch_lpn = lpn;
 		}
 
 		// issue remaining io
 		if (xfer_size > 0) {
 			srd.xfer_size = xfer_size;
 			srd.ppa = &prev_ppa;
-			nsecs_completed = ssd_advance_nand(conv_ftl->ssd, &srd);
+			nsecs_completed = __filter_advance(conv_ftl, &srd, out_size, cycles,
+							   &nsecs_sensed);
 			nsecs_latest = max(nsecs_completed, nsecs_latest);
+			__filter_sensed(sensed, batch_lpn - slpn, lpn - slpn, nr_parts,
+					nsecs_sensed);
 		}
 	}
+
+	if (sensed)
+		filter_shared_end(shared, slpn, ctx->nr_units);
 	
+	/* results produced at the end of the scan, e.g. aggregates */
+	nsecs_latest = ssd_advance_compute(conv_ftl->ssd, nsecs_latest, ctx->tail_cycles);
+	if (ctx->nr_tail > 0)
+		nsecs_latest = ssd_advance_pcie(conv_ftl->ssd, nsecs_latest, ctx->nr_tail);
+
 	/*----- 返回结果 -----*/
 	ret->nsecs_target = nsecs_latest;
-	ret->status = NVME_SC_SUCCESS;
+	ret->status = status;
+	ret->result0 = ctx->result0;
+	ret->result1 = ctx->result1;
+
+	filter_ctx_free(ctx);
 	return true;
 }
 
@@ -1099,6 +1246,7 @@ static bool conv_write(struct nvmev_ns *ns, struct nvmev_request *req, struct nv
 	/* wbuf and spp are shared by all instances */
 	struct ssdparams *spp = &conv_ftl->ssd->sp;
 	struct buffer *wbuf = conv_ftl->ssd->write_buffer;
+	struct filter_zonemap *zm = &conv_ftl->filter_zonemap;
 
 	struct nvme_command *cmd = req->cmd;
 	uint64_t lba = cmd->rw.slba;
@@ -1137,6 +1285,22 @@ static bool conv_write(struct nvmev_ns *ns, struct nvmev_request *req, struct nv
 		ssd_advance_write_buffer(conv_ftl->ssd, req->nsecs_start, LBA_TO_BYTE(nr_lba));
 	nsecs_xfer_completed = nsecs_latest;
 
+	if (filter_zonemap_enabled(zm)) {
+		struct filter_hbuf hb;
+
+		/* place the data already, the zone maps are computed from it */
+		filter_hbuf_init(&hb, cmd->rw.prp1, cmd->rw.prp2, LBA_TO_BYTE(nr_lba));
+		filter_hbuf_read(&hb, ns->mapped + LBA_TO_BYTE(lba), LBA_TO_BYTE(nr_lba));
+
+		filter_zonemap_update(zm, ns->mapped, LBA_TO_BYTE(lba), LBA_TO_BYTE(nr_lba));
+
+		/* so the IO worker does not copy it again */
+		ret->is_copied = true;
+	}
+
+	/* later filter commands cannot evaluate the new data on pages sensed before */
+	filter_shared_drop(&conv_ftl->filter_shared, start_lpn, end_lpn);
+
 	swr.stime = nsecs_latest;
 
 	for (lpn = start_lpn; lpn <= end_lpn; lpn++) {
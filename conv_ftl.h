@@ -7,6 +7,7 @@
 #include "pqueue/pqueue.h"
 #include "ssd_config.h"
 #include "ssd.h"
+#include "filter.h"
 
 struct convparams {
 	uint32_t gc_thres_lines;
@@ -65,6 +66,12 @@ struct conv_ftl {
 	struct write_pointer gc_wp;
 	struct line_mgmt lm;
 	struct write_flow_control wfc;
+	/* only used in the first instance */
+	struct filter_arena filter_arena;
+	struct filter_zonemap filter_zonemap;
+	struct filter_shared filter_shared;
+	struct filter_ctx filter_ctx; /* too large for the stack */
+	struct nvme_filter_desc filter_desc; /* of the command in filter_ctx */
 };
 
 void conv_init_namespace(struct nvmev_ns *ns, uint32_t id, uint64_t size, void *mapped_addr,
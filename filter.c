@@ -0,0 +1,1520 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <linux/highmem.h>
+#include <linux/jhash.h>
+#include <linux/slab.h>
+#include <asm/fpu/api.h>
+
+#include "nvmev.h"
+#include "filter.h"
+
+void filter_hbuf_init(struct filter_hbuf *hb, uint64_t prp1, uint64_t prp2, size_t size)
+{
+	size_t first = PAGE_SIZE - (prp1 & PAGE_OFFSET_MASK);
+
+	*hb = (struct filter_hbuf){
+		.prp1 = prp1,
+		.prp2 = prp2,
+		/* PRP2 points to a PRP list if the buffer spans more than two pages */
+		.prp_list = size > first + PAGE_SIZE,
+		.size = size,
+		.offs = 0,
+	};
+}
+
+static uint64_t __hbuf_paddr(struct filter_hbuf *hb, size_t offs)
+{
+	size_t first = PAGE_SIZE - (hb->prp1 & PAGE_OFFSET_MASK);
+	__le64 entry;
+
+	if (offs < first)
+		return hb->prp1 + offs;
+
+	offs -= first;
+	if (!hb->prp_list)
+		return hb->prp2 + offs;
+
+	filter_host_read(hb->prp2 + offs / PAGE_SIZE * sizeof(entry), &entry, sizeof(entry));
+	return le64_to_cpu(entry) + (offs % PAGE_SIZE);
+}
+
+static bool __hbuf_copy(struct filter_hbuf *hb, void *buf, size_t len, bool to_host)
+{
+	if (len > hb->size - hb->offs)
+		return false;
+
+	while (len) {
+		uint64_t paddr = __hbuf_paddr(hb, hb->offs);
+		size_t mem_offs = paddr & PAGE_OFFSET_MASK;
+		size_t io_size = min_t(size_t, len, PAGE_SIZE - mem_offs);
+		void *vaddr = kmap_atomic_pfn(PRP_PFN(paddr));
+
+		if (to_host)
+			memcpy(vaddr + mem_offs, buf, io_size);
+		else
+			memcpy(buf, vaddr + mem_offs, io_size);
+		kunmap_atomic(vaddr);
+
+		buf += io_size;
+		len -= io_size;
+		hb->offs += io_size;
+	}
+
+	return true;
+}
+
+/* Append @len bytes to the host buffer. Nothing is copied if they do not fit. */
+bool filter_hbuf_write(struct filter_hbuf *hb, const void *src, size_t len)
+{
+	return __hbuf_copy(hb, (void *)src, len, true);
+}
+
+/* Write @len bytes at @offs of the host buffer, leaving the position of the appends alone */
+bool filter_hbuf_pwrite(struct filter_hbuf *hb, size_t offs, const void *src, size_t len)
+{
+	size_t pos = hb->offs;
+	bool done;
+
+	hb->offs = offs;
+	done = __hbuf_copy(hb, (void *)src, len, true);
+	hb->offs = pos;
+
+	return done;
+}
+
+/* Consume the next @len bytes of the host buffer. Nothing is copied if they are not there. */
+bool filter_hbuf_read(struct filter_hbuf *hb, void *dst, size_t len)
+{
+	return __hbuf_copy(hb, dst, len, false);
+}
+
+/* Copy @len bytes from the physically contiguous host buffer at @paddr */
+void filter_host_read(uint64_t paddr, void *dst, size_t len)
+{
+	while (len) {
+		size_t mem_offs = paddr & PAGE_OFFSET_MASK;
+		size_t io_size = min_t(size_t, len, PAGE_SIZE - mem_offs);
+		void *vaddr = kmap_atomic_pfn(PRP_PFN(paddr));
+
+		memcpy(dst, vaddr + mem_offs, io_size);
+		kunmap_atomic(vaddr);
+
+		dst += io_size;
+		len -= io_size;
+		paddr += io_size;
+	}
+}
+
+static bool __check_pred(struct filter_pred *pred, uint32_t rec_size)
+{
+	if (pred->op >= NVME_FILTER_OP_NR) {
+		NVMEV_ERROR("%s: unknown filter op %u\n", __func__, pred->op);
+		return false;
+	}
+
+	if (rec_size == 0 || (pred->column + 1) * NVME_FILTER_COLUMN_SIZE > rec_size) {
+		NVMEV_ERROR("%s: column %u out of record (record_size=%u)\n", __func__,
+			    pred->column, rec_size);
+		return false;
+	}
+
+	return true;
+}
+
+static inline bool __is_like(uint32_t op)
+{
+	return op == NVME_FILTER_OP_LIKE || op == NVME_FILTER_OP_NOT_LIKE;
+}
+
+/* Compile the pattern of a LIKE clause, which then refers to it by its index in ctx->likes */
+static bool __parse_like(struct filter_ctx *ctx, struct filter_pred *pred)
+{
+	const struct nvme_filter_pattern *pattern;
+	uint32_t index = pred->value;
+
+	if (pred->column >= ctx->nr_columns ||
+	    (ctx->columns[pred->column].type != NVME_FILTER_TYPE_BPCHAR &&
+	     ctx->columns[pred->column].type != NVME_FILTER_TYPE_VARCHAR)) {
+		NVMEV_ERROR("%s: column %u is not a string\n", __func__, pred->column);
+		return false;
+	}
+
+	if (index >= NVME_FILTER_MAX_PATTERNS || ctx->nr_likes == NVME_FILTER_MAX_PATTERNS) {
+		NVMEV_ERROR("%s: invalid pattern %u\n", __func__, index);
+		return false;
+	}
+
+	pattern = &ctx->desc->patterns[index];
+	if (!filter_like_compile(&ctx->likes[ctx->nr_likes], pred->column, pattern->pattern,
+				 pattern->len))
+		return false;
+
+	ctx->like_cols |= 1U << pred->column;
+	pred->value = ctx->nr_likes++;
+
+	return true;
+}
+
+/* Take a reference to the Bloom filter of an IN_BLOOM clause, which keeps its id */
+static bool __parse_bloom(struct filter_ctx *ctx, struct filter_pred *pred)
+{
+	uint32_t id = pred->value;
+
+	if (id >= NVME_FILTER_MAX_BLOOMS) {
+		NVMEV_ERROR("%s: invalid Bloom filter %u\n", __func__, id);
+		return false;
+	}
+
+	if (!ctx->blooms[id])
+		ctx->blooms[id] = filter_bloom_get(id);
+	if (!ctx->blooms[id]) {
+		NVMEV_ERROR("%s: Bloom filter %u is not loaded\n", __func__, id);
+		return false;
+	}
+
+	ctx->nr_probes++;
+	return true;
+}
+
+/*
+ * @c / 10^@digits, rounded down if @floor is set and up otherwise. @exact
+ * tells whether nothing was rounded.
+ */
+static int64_t __div_pow10(int64_t c, uint32_t digits, bool floor, bool *exact)
+{
+	int64_t q = c;
+
+	*exact = true;
+	for (; digits && q; digits--) {
+		*exact &= q % 10 == 0;
+		q /= 10;
+	}
+
+	if (!*exact && floor && c < 0)
+		q--;
+	else if (!*exact && !floor && c > 0)
+		q++;
+
+	return q;
+}
+
+static int64_t __rescale(int64_t c, uint32_t from, uint32_t to, bool floor, bool *exact)
+{
+	*exact = true;
+	if (from > to)
+		return __div_pow10(c, from - to, floor, exact);
+
+	/* out of range anyway once past 32 bits */
+	for (; from < to && c >= S32_MIN && c <= S32_MAX; from++)
+		c *= 10;
+
+	return c;
+}
+
+/*
+ * The constants of a clause, in the encoding of the values of its column.
+ * They are 32-bit, unless they are converted: dates given since 1970 are
+ * moved to 2000, and 64-bit decimals are rescaled to the digits kept of the
+ * column, then clamped. A bound finer than those is rounded so
+ * that comparing with it selects the same values: down for <= and >, up
+ * for < and >=. An equality that cannot hold becomes an empty BETWEEN, and
+ * an inequality that always does a full one.
+ */
+static void __parse_consts(struct filter_ctx *ctx, struct filter_pred *pred,
+			   const struct nvme_filter_clause *clause)
+{
+	int64_t lo = (int32_t)le64_to_cpu(clause->value[0]);
+	int64_t hi = (int32_t)le64_to_cpu(clause->value[1]);
+	const struct filter_column *col = NULL;
+	bool floor = pred->op == NVME_FILTER_OP_LE || pred->op == NVME_FILTER_OP_GT ||
+		     pred->op == NVME_FILTER_OP_EQ || pred->op == NVME_FILTER_OP_NE;
+	bool exact = true, exact_hi;
+
+	if (pred->column < ctx->nr_columns)
+		col = &ctx->columns[pred->column];
+
+	if (col && col->type == NVME_FILTER_TYPE_DATE &&
+	    (clause->flags & NVME_FILTER_CLAUSE_UNIX_DATE)) {
+		lo -= FILTER_PG_EPOCH_DAYS;
+		hi -= FILTER_PG_EPOCH_DAYS;
+	}
+
+	if (col && col->type == NVME_FILTER_TYPE_NUMERIC &&
+	    (clause->flags & NVME_FILTER_CLAUSE_SCALE)) {
+		lo = __rescale((int64_t)le64_to_cpu(clause->value[0]), clause->scale, col->scale,
+			       floor, &exact);
+		hi = __rescale((int64_t)le64_to_cpu(clause->value[1]), clause->scale, col->scale,
+			       true, &exact_hi);
+	}
+
+	pred->value = clamp_t(int64_t, lo, S32_MIN, S32_MAX);
+	pred->high = clamp_t(int64_t, hi, S32_MIN, S32_MAX);
+
+	if (!exact && pred->op == NVME_FILTER_OP_EQ) {
+		pred->op = NVME_FILTER_OP_BETWEEN;
+		pred->value = 1;
+		pred->high = 0;
+	} else if (!exact && pred->op == NVME_FILTER_OP_NE) {
+		pred->op = NVME_FILTER_OP_BETWEEN;
+		pred->value = S32_MIN;
+		pred->high = S32_MAX;
+	}
+}
+
+static bool __parse_desc(struct filter_ctx *ctx)
+{
+	struct filter_prog *prog = &ctx->prog;
+	uint32_t i, nr_clauses = le16_to_cpu(ctx->desc->nr_clauses);
+
+	if (nr_clauses > NVME_FILTER_MAX_CLAUSES) {
+		NVMEV_ERROR("%s: invalid number of clauses %u\n", __func__, nr_clauses);
+		return false;
+	}
+
+	for (i = 0; i < nr_clauses; i++) {
+		const struct nvme_filter_clause *clause = &ctx->desc->clauses[i];
+		struct filter_pred *pred = &prog->preds[i];
+
+		pred->column = le16_to_cpu(clause->column);
+		pred->op = clause->op;
+		pred->new_term = i > 0 && (clause->flags & NVME_FILTER_CLAUSE_OR);
+
+		if (!__check_pred(pred, ctx->rec_size))
+			return false;
+
+		if (__is_like(pred->op)) {
+			pred->value = (int32_t)le64_to_cpu(clause->value[0]);
+			if (!__parse_like(ctx, pred))
+				return false;
+		} else if (pred->op == NVME_FILTER_OP_IN_BLOOM) {
+			pred->value = (int32_t)le64_to_cpu(clause->value[0]);
+			if (!__parse_bloom(ctx, pred))
+				return false;
+		} else {
+			__parse_consts(ctx, pred, clause);
+		}
+	}
+	prog->nr_preds = nr_clauses;
+
+	return true;
+}
+
+static bool __parse_prog(struct nvme_filter_command *cmd, struct filter_ctx *ctx)
+{
+	struct filter_prog *prog = &ctx->prog;
+	struct filter_pred *pred = &prog->preds[0];
+
+	if (ctx->desc)
+		return __parse_desc(ctx);
+
+	pred->column = le32_to_cpu(cmd->filter_index);
+	pred->op = le32_to_cpu(cmd->filter_op);
+	pred->value = (int32_t)le32_to_cpu(cmd->filter_const);
+	pred->new_term = false;
+	prog->nr_preds = 1;
+
+	if (__is_like(pred->op) || pred->op == NVME_FILTER_OP_BETWEEN ||
+	    pred->op == NVME_FILTER_OP_IN_BLOOM) {
+		NVMEV_ERROR("%s: op %u needs a descriptor\n", __func__, pred->op);
+		return false;
+	}
+
+	return __check_pred(pred, ctx->rec_size);
+}
+
+static bool __parse_table(struct nvme_filter_command *cmd, struct filter_ctx *ctx,
+			  struct nvme_filter_table *table)
+{
+	uint64_t cmd_slba = le64_to_cpu(cmd->slba), slba, nlb;
+	uint32_t cmd_nlb = le16_to_cpu(cmd->length) + 1;
+	uint32_t index = le32_to_cpu(cmd->filter_index);
+
+	if (!ctx->desc) {
+		NVMEV_ERROR("%s: predicates on a table need a descriptor\n", __func__);
+		return false;
+	}
+
+	if (!filter_table_get(index, table)) {
+		NVMEV_ERROR("%s: unknown table %u\n", __func__, index);
+		return false;
+	}
+
+	/* a streaming command scans the whole table */
+	slba = le64_to_cpu(table->slba);
+	nlb = le64_to_cpu(table->nlb);
+	if (le32_to_cpu(table->nsid) != le32_to_cpu(cmd->nsid) ||
+	    (!(le16_to_cpu(cmd->filter_flags) & NVME_FILTER_FLAG_STREAM) &&
+	     (cmd_slba < slba || cmd_slba + cmd_nlb > slba + nlb))) {
+		NVMEV_ERROR("%s: LBAs %llu+%u out of table %u\n", __func__, cmd_slba, cmd_nlb,
+			    index);
+		return false;
+	}
+
+	return true;
+}
+
+/* the layout of the records, given by a registered table or by the descriptor */
+static bool __parse_layout(struct nvme_filter_command *cmd, struct filter_ctx *ctx,
+			   struct nvme_filter_table *layout)
+{
+	const struct nvme_filter_desc *desc = ctx->desc;
+
+	memset(layout, 0, sizeof(*layout));
+	layout->record_size = cmd->record_size;
+
+	if (le16_to_cpu(cmd->filter_flags) & NVME_FILTER_FLAG_TABLE)
+		return __parse_table(cmd, ctx, layout);
+
+	if (!desc)
+		return true;
+
+	layout->format = desc->format;
+	layout->nr_columns = desc->nr_columns;
+	layout->delim = desc->delim;
+
+	if (layout->nr_columns <= NVME_FILTER_MAX_COLUMNS)
+		memcpy(layout->columns, desc->columns,
+		       layout->nr_columns * sizeof(layout->columns[0]));
+
+	return true;
+}
+
+static bool __parse_format(struct nvme_filter_command *cmd, struct filter_ctx *ctx)
+{
+	struct nvme_filter_table layout;
+	uint32_t i;
+
+	if (!__parse_layout(cmd, ctx, &layout) || !filter_format_valid(&layout))
+		return false;
+
+	ctx->format = layout.format;
+	ctx->rec_size = le16_to_cpu(layout.record_size);
+	ctx->extent_offs = LBA_TO_BYTE(le64_to_cpu(layout.slba));
+	ctx->extent_len = LBA_TO_BYTE(le64_to_cpu(layout.nlb));
+
+	if (ctx->format == NVME_FILTER_FMT_BLOCKS) {
+		ctx->block = kmalloc(NVME_FILTER_BLOCK_MAX_SIZE, GFP_KERNEL);
+		ctx->code = kcalloc(NVME_FILTER_MAX_CLAUSES, sizeof(*ctx->code), GFP_KERNEL);
+		if (!ctx->block || !ctx->code) {
+			NVMEV_ERROR("%s: failed to allocate the block buffers\n", __func__);
+			return false;
+		}
+	}
+
+	if (!filter_formats[ctx->format]->typed)
+		return true;
+
+	ctx->delim = layout.delim ? layout.delim : '|';
+	ctx->nr_columns = layout.nr_columns;
+	for (i = 0; i < ctx->nr_columns; i++) {
+		ctx->columns[i] = (struct filter_column){
+			.type = layout.columns[i].type,
+			.scale = layout.columns[i].scale,
+		};
+	}
+
+	/* the decoded columns followed by the NULL bitmap */
+	ctx->rec_size = (ctx->nr_columns + 1) * NVME_FILTER_COLUMN_SIZE;
+	ctx->rows = kmalloc(FILTER_BATCH * ctx->rec_size, GFP_KERNEL);
+	if (!ctx->rows) {
+		NVMEV_ERROR("%s: failed to allocate the row buffer\n", __func__);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * The bytes scanned: the LBA range of the command, or the part of the
+ * extent from the cursor on when streaming. The extent must be within the
+ * @ns_size bytes of the namespace.
+ */
+static bool __parse_scan(struct nvme_filter_command *cmd, struct filter_ctx *ctx, uint64_t ns_size)
+{
+	const struct filter_format *fmt = filter_formats[ctx->format];
+	uint32_t flags = le16_to_cpu(cmd->filter_flags);
+	uint64_t slba = le64_to_cpu(cmd->slba), base, nlb;
+
+	ctx->stream = flags & NVME_FILTER_FLAG_STREAM;
+	if (!ctx->stream) {
+		ctx->scan_offs = LBA_TO_BYTE(slba);
+		ctx->scan_len = LBA_TO_BYTE((uint64_t)le16_to_cpu(cmd->length) + 1);
+		return true;
+	}
+
+	if (!ctx->desc) {
+		NVMEV_ERROR("%s: streaming needs a descriptor\n", __func__);
+		return false;
+	}
+
+	/* the extent of a table is known already */
+	if (!(flags & NVME_FILTER_FLAG_TABLE)) {
+		nlb = le64_to_cpu(ctx->desc->stream_nlb);
+		if (nlb > BYTE_TO_LBA(ns_size) || slba > BYTE_TO_LBA(ns_size) - nlb) {
+			NVMEV_ERROR("%s: extent %llu+%llu out of the namespace\n", __func__, slba,
+				    nlb);
+			return false;
+		}
+
+		ctx->extent_offs = LBA_TO_BYTE(slba);
+		ctx->extent_len = LBA_TO_BYTE(nlb);
+	}
+
+	ctx->cursor = ((uint64_t)le32_to_cpu(cmd->filter_const) << 32) |
+		      le32_to_cpu(cmd->filter_op);
+	base = rounddown(ctx->cursor, fmt->cursor_align);
+	if (base >= ctx->extent_len) {
+		NVMEV_ERROR("%s: cursor %llu out of the extent\n", __func__, ctx->cursor);
+		return false;
+	}
+
+	ctx->first_item = ctx->cursor - base;
+	ctx->scan_offs = ctx->extent_offs + base;
+	ctx->scan_len = min_t(uint64_t, ctx->extent_len - base, FILTER_MAX_SCAN_SIZE);
+
+	return true;
+}
+
+static bool __parse_proj(struct nvme_filter_command *cmd, struct filter_ctx *ctx)
+{
+	uint32_t i, mask = le32_to_cpu(cmd->proj_mask);
+
+	ctx->nr_proj = 0;
+
+	if (ctx->desc) {
+		ctx->nr_proj = le16_to_cpu(ctx->desc->nr_proj);
+		if (ctx->nr_proj > NVME_FILTER_MAX_PROJ) {
+			NVMEV_ERROR("%s: too many projected columns %u\n", __func__, ctx->nr_proj);
+			return false;
+		}
+
+		for (i = 0; i < ctx->nr_proj; i++)
+			ctx->proj[i] = le16_to_cpu(ctx->desc->proj[i]);
+	}
+
+	if (ctx->nr_proj == 0) {
+		for (i = 0; i < NVME_FILTER_MAX_PROJ; i++) {
+			if (mask & (1U << i))
+				ctx->proj[ctx->nr_proj++] = i;
+		}
+	}
+
+	for (i = 0; i < ctx->nr_proj; i++) {
+		if ((ctx->proj[i] + 1) * NVME_FILTER_COLUMN_SIZE > ctx->rec_size) {
+			NVMEV_ERROR("%s: projected column %u out of record (record_size=%u)\n",
+				    __func__, ctx->proj[i], ctx->rec_size);
+			return false;
+		}
+	}
+
+	if (ctx->nr_proj)
+		ctx->out_size = ctx->nr_proj * NVME_FILTER_COLUMN_SIZE;
+	else
+		ctx->out_size = ctx->rec_size;
+
+	return true;
+}
+
+static bool __parse_aggs(struct filter_ctx *ctx)
+{
+	uint32_t i;
+
+	ctx->nr_aggs = 0;
+	if (!ctx->desc)
+		return true;
+
+	ctx->nr_aggs = le16_to_cpu(ctx->desc->nr_aggs);
+	if (ctx->nr_aggs > NVME_FILTER_MAX_AGGS) {
+		NVMEV_ERROR("%s: too many aggregates %u\n", __func__, ctx->nr_aggs);
+		return false;
+	}
+
+	for (i = 0; i < ctx->nr_aggs; i++) {
+		struct filter_agg *agg = &ctx->aggs[i];
+
+		*agg = (struct filter_agg){
+			.func = ctx->desc->aggs[i].func,
+			.column = le16_to_cpu(ctx->desc->aggs[i].column),
+			.acc = { 0 },
+		};
+
+		if (agg->func >= NVME_FILTER_AGG_NR) {
+			NVMEV_ERROR("%s: unknown aggregate %u\n", __func__, agg->func);
+			return false;
+		}
+
+		if (agg->func != NVME_FILTER_AGG_COUNT &&
+		    (agg->column + 1) * NVME_FILTER_COLUMN_SIZE > ctx->rec_size) {
+			NVMEV_ERROR("%s: aggregated column %u out of record (record_size=%u)\n",
+				    __func__, agg->column, ctx->rec_size);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool __parse_groups(struct filter_ctx *ctx)
+{
+	uint32_t i, keys[NVME_FILTER_MAX_GROUP_KEYS];
+
+	ctx->nr_group_keys = 0;
+	if (!ctx->desc)
+		return true;
+
+	ctx->nr_group_keys = le16_to_cpu(ctx->desc->nr_group_keys);
+	if (ctx->nr_group_keys == 0)
+		return true;
+
+	if (ctx->nr_group_keys > NVME_FILTER_MAX_GROUP_KEYS || ctx->nr_aggs == 0) {
+		NVMEV_ERROR("%s: invalid grouping (%u keys, %u aggregates)\n", __func__,
+			    ctx->nr_group_keys, ctx->nr_aggs);
+		return false;
+	}
+
+	for (i = 0; i < ctx->nr_group_keys; i++) {
+		keys[i] = le16_to_cpu(ctx->desc->group_keys[i]);
+		if ((keys[i] + 1) * NVME_FILTER_COLUMN_SIZE > ctx->rec_size) {
+			NVMEV_ERROR("%s: group key column %u out of record (record_size=%u)\n",
+				    __func__, keys[i], ctx->rec_size);
+			return false;
+		}
+	}
+
+	filter_arena_reset(ctx->arena);
+	if (!filter_groups_init(&ctx->groups, ctx->arena, ctx->nr_group_keys, keys,
+				ctx->nr_aggs)) {
+		NVMEV_ERROR("%s: no device memory for grouping\n", __func__);
+		return false;
+	}
+
+	return true;
+}
+
+static bool __parse_output(struct filter_ctx *ctx)
+{
+	ctx->output = NVME_FILTER_OUT_ROWS;
+	if (!ctx->desc)
+		return true;
+
+	ctx->output = ctx->desc->output;
+	if (ctx->output >= NVME_FILTER_OUT_NR) {
+		NVMEV_ERROR("%s: unknown output %u\n", __func__, ctx->output);
+		return false;
+	}
+
+	if (ctx->output != NVME_FILTER_OUT_ROWS && ctx->nr_aggs) {
+		NVMEV_ERROR("%s: output %u cannot be aggregated\n", __func__, ctx->output);
+		return false;
+	}
+
+	return true;
+}
+
+static bool __parse_topk(struct filter_ctx *ctx)
+{
+	uint32_t limit, column;
+
+	ctx->topk.k = 0;
+	if (!ctx->desc)
+		return true;
+
+	limit = le32_to_cpu(ctx->desc->limit);
+	column = le16_to_cpu(ctx->desc->order_column);
+	if (limit == 0)
+		return true;
+
+	if (ctx->nr_aggs || ctx->output != NVME_FILTER_OUT_ROWS) {
+		NVMEV_ERROR("%s: Top-K returns rows only\n", __func__);
+		return false;
+	}
+
+	if ((column + 1) * NVME_FILTER_COLUMN_SIZE > ctx->rec_size) {
+		NVMEV_ERROR("%s: order column %u out of record (record_size=%u)\n", __func__,
+			    column, ctx->rec_size);
+		return false;
+	}
+
+	filter_arena_reset(ctx->arena);
+	if (!filter_topk_init(&ctx->topk, ctx->arena, limit, column, ctx->desc->order_desc,
+			      ctx->out_size)) {
+		NVMEV_ERROR("%s: no device memory for the top %u records\n", __func__, limit);
+		return false;
+	}
+
+	return true;
+}
+
+/* The statistics of the projected columns, or of all of them, with NVME_FILTER_OUT_STATS */
+static bool __parse_stats(struct filter_ctx *ctx)
+{
+	uint16_t cols[NVME_FILTER_MAX_PROJ];
+	uint32_t i, nr_cols = ctx->nr_proj, nr_buckets;
+
+	/* only given by a descriptor */
+	if (ctx->output != NVME_FILTER_OUT_STATS)
+		return true;
+
+	nr_buckets = le16_to_cpu(ctx->desc->nr_buckets);
+	if (nr_buckets > NVME_FILTER_MAX_BUCKETS) {
+		NVMEV_ERROR("%s: too many buckets %u\n", __func__, nr_buckets);
+		return false;
+	}
+
+	/* the NULL bitmap of typed formats is not a column */
+	if (nr_cols == 0) {
+		nr_cols = ctx->nr_columns;
+		if (nr_cols == 0)
+			nr_cols = ctx->rec_size / NVME_FILTER_COLUMN_SIZE;
+		if (nr_cols > NVME_FILTER_MAX_PROJ) {
+			NVMEV_ERROR("%s: too many columns %u\n", __func__, nr_cols);
+			return false;
+		}
+	}
+
+	for (i = 0; i < nr_cols; i++)
+		cols[i] = ctx->nr_proj ? ctx->proj[i] : i;
+
+	filter_arena_reset(ctx->arena);
+	if (!filter_stats_init(&ctx->stats, ctx->arena, nr_cols, cols, nr_buckets)) {
+		NVMEV_ERROR("%s: no device memory for the statistics of %u columns\n", __func__,
+			    nr_cols);
+		return false;
+	}
+
+	return true;
+}
+
+static bool __parse_sample(struct filter_ctx *ctx)
+{
+	ctx->sample = NVME_FILTER_SAMPLE_NONE;
+	if (!ctx->desc)
+		return true;
+
+	ctx->sample = ctx->desc->sample;
+	if (ctx->sample == NVME_FILTER_SAMPLE_NONE)
+		return true;
+
+	if (ctx->sample >= NVME_FILTER_SAMPLE_NR) {
+		NVMEV_ERROR("%s: unknown sampling %u\n", __func__, ctx->sample);
+		return false;
+	}
+
+	ctx->sample_seed = le32_to_cpu(ctx->desc->sample_seed);
+	ctx->sample_max = ((uint64_t)le32_to_cpu(ctx->desc->sample_rate) << 32) /
+			  NVME_FILTER_SAMPLE_SCALE;
+
+	/* a stream resumes within a block at record first_item */
+	ctx->sample_offs = U32_MAX;
+	ctx->sample_dup = ctx->format == NVME_FILTER_FMT_BLOCKS ? ctx->first_item : 0;
+
+	return true;
+}
+
+/* Bytes of headers at the start of the host buffer */
+static size_t __hdrs_size(struct filter_ctx *ctx)
+{
+	size_t size = 0;
+
+	if (ctx->stream)
+		size += sizeof(struct nvme_filter_stream_hdr);
+	if (ctx->sample)
+		size += sizeof(struct nvme_filter_sample_hdr);
+
+	return size;
+}
+
+/* The regions of the host buffer of @size bytes the partitions are written to */
+static bool __parse_parts(struct filter_ctx *ctx, size_t size)
+{
+	const struct nvme_filter_desc *desc = ctx->desc;
+	size_t end = __hdrs_size(ctx);
+	uint32_t i;
+
+	ctx->nr_parts = 0;
+	if (!desc || desc->nr_parts == 0)
+		return true;
+
+	ctx->nr_parts = le16_to_cpu(desc->nr_parts);
+	ctx->part_column = le16_to_cpu(desc->part_column);
+	ctx->part_seed = le32_to_cpu(desc->part_seed);
+
+	if (ctx->nr_parts > NVME_FILTER_MAX_PARTS) {
+		NVMEV_ERROR("%s: too many partitions %u\n", __func__, ctx->nr_parts);
+		return false;
+	}
+
+	if (ctx->nr_aggs || ctx->topk.k || ctx->output != NVME_FILTER_OUT_ROWS) {
+		NVMEV_ERROR("%s: only rows can be partitioned\n", __func__);
+		return false;
+	}
+
+	if ((ctx->part_column + 1) * NVME_FILTER_COLUMN_SIZE > ctx->rec_size) {
+		NVMEV_ERROR("%s: partition column %u out of record (record_size=%u)\n", __func__,
+			    ctx->part_column, ctx->rec_size);
+		return false;
+	}
+
+	filter_arena_reset(ctx->arena);
+	ctx->parts = filter_arena_alloc(ctx->arena, ctx->nr_parts * sizeof(ctx->parts[0]));
+	if (!ctx->parts) {
+		NVMEV_ERROR("%s: no device memory for %u partitions\n", __func__, ctx->nr_parts);
+		return false;
+	}
+
+	for (i = 0; i < ctx->nr_parts; i++) {
+		struct filter_part *part = &ctx->parts[i];
+
+		part->offs = le32_to_cpu(desc->parts[i].offs);
+		part->size = le32_to_cpu(desc->parts[i].size);
+		part->used = sizeof(struct nvme_filter_part_hdr);
+		part->nr_rows = 0;
+
+		/* in order, after the headers */
+		if (part->offs < end || part->size < part->used || part->size > size ||
+		    part->offs > size - part->size) {
+			NVMEV_ERROR("%s: partition %u at %zu+%zu out of the host buffer\n",
+				    __func__, i, part->offs, part->size);
+			return false;
+		}
+		end = part->offs + part->size;
+	}
+
+	return true;
+}
+
+/* Bytes a group takes in the host buffer */
+static size_t __group_size(struct filter_ctx *ctx)
+{
+	return ALIGN((ctx->nr_group_keys + 1) * sizeof(__le32), sizeof(__le64)) +
+	       ctx->nr_aggs * sizeof(struct nvme_filter_agg_result);
+}
+
+/*
+ * Leave room for the headers of the host buffer, and keep no more groups
+ * than it holds, the records of the others being spilled. A streaming
+ * command also keeps the other results known only at the end within it,
+ * as it cannot spill.
+ */
+static bool __reserve_hdrs(struct filter_ctx *ctx)
+{
+	size_t hdr_size = __hdrs_size(ctx);
+	size_t aggs_size = ctx->nr_aggs * sizeof(struct nvme_filter_agg_result);
+	size_t avail;
+
+	if (ctx->hb.size <= hdr_size)
+		return false;
+	avail = ctx->hb.size - hdr_size;
+	ctx->hb.offs = hdr_size;
+
+	if (ctx->nr_group_keys) {
+		ctx->groups.max_groups = min_t(size_t, ctx->groups.max_groups,
+					       avail / __group_size(ctx));
+		return ctx->groups.max_groups > 0;
+	}
+
+	if (!ctx->stream)
+		return true;
+
+	if (ctx->topk.k)
+		return (size_t)ctx->topk.k * ctx->out_size <= avail;
+
+	if (ctx->output == NVME_FILTER_OUT_STATS)
+		return (size_t)ctx->stats.nr_cols * ctx->stats.entry_size <= avail;
+
+	return aggs_size <= avail;
+}
+
+/* Whether the page, or the @n-th record, at byte @pos of the namespace is in the sample */
+static inline bool __sampled(struct filter_ctx *ctx, uint64_t pos, uint32_t n)
+{
+	return jhash_3words(lower_32_bits(pos), upper_32_bits(pos), n, ctx->sample_seed) <
+	       ctx->sample_max;
+}
+
+/*
+ * Mark the units of the pages out of the sample, which are not read, heap
+ * pages as a whole. Those start every cursor_align bytes from the extent,
+ * as the scan does, rather than from the namespace.
+ */
+static void __sample_pages(struct filter_ctx *ctx)
+{
+	uint32_t unit_size = ctx->unit_size;
+	uint32_t align = filter_formats[ctx->format]->cursor_align;
+	uint64_t pos = ctx->scan_offs - ctx->unit_offs;
+	uint32_t i;
+
+	for (i = 0; i < ctx->nr_units; i++, pos += unit_size) {
+		uint64_t page = pos;
+
+		if (align > unit_size)
+			page = ctx->scan_offs + (i ? rounddown(pos - ctx->scan_offs, align) : 0);
+
+		ctx->units[i].unsampled = !__sampled(ctx, page, 0);
+	}
+}
+
+/*
+ * The descriptor, if any, is read once into @desc, so that the host cannot
+ * change it while it is parsed.
+ */
+uint32_t filter_ctx_init(struct filter_ctx *ctx, struct nvme_filter_command *cmd,
+			 struct nvme_filter_desc *desc, struct filter_arena *arena,
+			 uint32_t unit_size, uint64_t ns_size)
+{
+	size_t length = LBA_TO_BYTE((size_t)le16_to_cpu(cmd->length) + 1);
+
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->arena = arena;
+
+	if (le16_to_cpu(cmd->filter_flags) & NVME_FILTER_FLAG_DESC) {
+		filter_host_read(le64_to_cpu(cmd->metadata), desc, sizeof(*desc));
+		ctx->desc = desc;
+	}
+
+	if (!__parse_format(cmd, ctx) || !__parse_scan(cmd, ctx, ns_size) ||
+	    !__parse_prog(cmd, ctx))
+		return NVME_SC_INVALID_FIELD;
+
+	if (!__parse_proj(cmd, ctx) || !__parse_aggs(ctx) || !__parse_groups(ctx) ||
+	    !__parse_output(ctx) || !__parse_topk(ctx) || !__parse_stats(ctx) ||
+	    !__parse_sample(ctx) || !__parse_parts(ctx, length))
+		return NVME_SC_INVALID_FIELD;
+
+	ctx->unit_size = unit_size;
+	ctx->unit_offs = ctx->scan_offs % unit_size;
+	ctx->nr_units = DIV_ROUND_UP(ctx->unit_offs + ctx->scan_len, unit_size);
+	ctx->units = kcalloc(ctx->nr_units, sizeof(struct filter_unit), GFP_KERNEL);
+	if (!ctx->units)
+		return NVME_SC_INTERNAL;
+
+	if (ctx->sample == NVME_FILTER_SAMPLE_PAGES)
+		__sample_pages(ctx);
+
+	ctx->rec_cycles = FILTER_CYCLES_PER_TUPLE + ctx->rec_size * FILTER_CYCLES_PER_BYTE +
+			  ctx->prog.nr_preds * FILTER_CYCLES_PER_PRED +
+			  ctx->nr_probes * FILTER_CYCLES_PER_PROBE;
+	ctx->fold_cycles = ctx->nr_aggs * FILTER_CYCLES_PER_AGG;
+	if (ctx->nr_group_keys)
+		ctx->fold_cycles += FILTER_CYCLES_PER_GROUP;
+	if (ctx->output == NVME_FILTER_OUT_STATS)
+		ctx->fold_cycles = ctx->stats.nr_cols * FILTER_CYCLES_PER_STATS;
+	if (ctx->sample == NVME_FILTER_SAMPLE_ROWS)
+		ctx->rec_cycles += FILTER_CYCLES_PER_SAMPLE;
+
+	filter_hbuf_init(&ctx->hb, le64_to_cpu(cmd->prp1), le64_to_cpu(cmd->prp2), length);
+	if (!__reserve_hdrs(ctx)) {
+		NVMEV_ERROR("%s: host buffer too small for the results\n", __func__);
+		return NVME_SC_CAP_EXCEEDED;
+	}
+
+	return NVME_SC_SUCCESS;
+}
+
+void filter_ctx_free(struct filter_ctx *ctx)
+{
+	uint32_t i;
+
+	for (i = 0; i < NVME_FILTER_MAX_BLOOMS; i++) {
+		if (ctx->blooms[i])
+			filter_bloom_put(ctx->blooms[i]);
+		ctx->blooms[i] = NULL;
+	}
+
+	filter_topk_free(&ctx->topk);
+	kfree(ctx->units);
+	kfree(ctx->rows);
+	kfree(ctx->block);
+	kfree(ctx->code);
+	ctx->units = NULL;
+	ctx->rows = NULL;
+	ctx->block = NULL;
+	ctx->code = NULL;
+}
+
+/* LIKE clauses are matched while the rows are decoded */
+static inline uint64_t __like_sel(struct filter_ctx *ctx, struct filter_pred *pred)
+{
+	uint64_t sel = ctx->like_sel[pred->value];
+
+	return pred->op == NVME_FILTER_OP_LIKE ? sel : ~sel;
+}
+
+/*
+ * Evaluate the predicates on @nr consecutive records, up to FILTER_BATCH,
+ * returning the selection bitmap
+ */
+uint64_t filter_eval_rows(struct filter_ctx *ctx, const void *recs, uint32_t nr)
+{
+	const struct filter_kernels *k = filter_kernels;
+	uint64_t all = nr < 64 ? (1ULL << nr) - 1 : ~0ULL;
+	uint64_t sel = 0, term = all;
+	uint32_t i;
+
+	if (k->fpu)
+		kernel_fpu_begin();
+
+	if (ctx->nr_likes)
+		filter_like_batch(ctx, nr);
+
+	for (i = 0; i < ctx->prog.nr_preds; i++) {
+		struct filter_pred *pred = &ctx->prog.preds[i];
+
+		if (pred->new_term) {
+			sel |= term;
+			term = all;
+		}
+
+		/* the rest of a term no record satisfies need not be evaluated */
+		if (term && __is_like(pred->op))
+			term &= __like_sel(ctx, pred);
+		else if (term && (ctx->code_preds & (1U << i)))
+			term &= ctx->code[i].sel;
+		else if (term && pred->op == NVME_FILTER_OP_IN_BLOOM)
+			term &= filter_bloom_test(ctx->blooms[pred->value], recs, nr,
+						  ctx->rec_size, pred->column);
+		else if (term)
+			term &= k->cmp_i32(recs, nr, ctx->rec_size, pred);
+
+		/* NULL satisfies no predicate */
+		if (term && pred->column < ctx->nr_columns)
+			term &= ~ctx->nulls[pred->column];
+	}
+
+	if (k->fpu)
+		kernel_fpu_end();
+
+	return sel | term;
+}
+
+/* aggregates other than COUNT skip NULL columns */
+static inline bool __agg_skips(struct filter_ctx *ctx, struct filter_agg *agg, uint32_t nulls)
+{
+	return agg->func != NVME_FILTER_AGG_COUNT && agg->column < ctx->nr_columns &&
+	       (nulls & (1U << agg->column));
+}
+
+/* Returns false if the group of @rec does not fit in the device memory */
+static bool __fold(struct filter_ctx *ctx, const void *rec)
+{
+	struct filter_acc *accs = NULL;
+	struct filter_group *group;
+	uint32_t i, nulls = 0, key_nulls = 0;
+
+	if (ctx->nr_columns)
+		nulls = filter_get_column(rec, ctx->nr_columns);
+
+	if (ctx->nr_group_keys) {
+		for (i = 0; i < ctx->nr_group_keys; i++) {
+			uint32_t column = ctx->groups.keys[i];
+
+			if (column < ctx->nr_columns && (nulls & (1U << column)))
+				key_nulls |= 1U << i;
+		}
+
+		group = filter_groups_get(&ctx->groups, rec, key_nulls);
+		if (!group)
+			return false;
+		accs = group->accs;
+	}
+
+	for (i = 0; i < ctx->nr_aggs; i++) {
+		struct filter_agg *agg = &ctx->aggs[i];
+
+		if (!__agg_skips(ctx, agg, nulls))
+			filter_acc_fold(agg, accs ? &accs[i] : &agg->acc, rec);
+	}
+
+	return true;
+}
+
+static void __project(struct filter_ctx *ctx, const void *rec, void *tuple)
+{
+	uint32_t i;
+
+	for (i = 0; i < ctx->nr_proj; i++) {
+		memcpy(tuple + i * NVME_FILTER_COLUMN_SIZE,
+		       rec + ctx->proj[i] * NVME_FILTER_COLUMN_SIZE, NVME_FILTER_COLUMN_SIZE);
+	}
+}
+
+/* Keep a matching record if it is among the top K so far */
+static void __keep(struct filter_ctx *ctx, struct filter_unit *unit, const void *rec)
+{
+	uint32_t column = ctx->topk.column;
+	bool null = column < ctx->nr_columns &&
+		    (filter_get_column(rec, ctx->nr_columns) & (1U << column));
+	void *slot = filter_topk_slot(&ctx->topk,
+				      filter_topk_pri(filter_get_column(rec, column), null));
+
+	if (!slot)
+		return;
+
+	if (ctx->nr_proj)
+		__project(ctx, rec, slot);
+	else
+		memcpy(slot, rec, ctx->rec_size);
+	unit->cycles += FILTER_CYCLES_PER_HEAP;
+}
+
+/* The host buffer is full, the scan stops before row @row of the batch */
+static bool __stop(struct filter_ctx *ctx, uint32_t row)
+{
+	ctx->full = true;
+	ctx->stop_row = row;
+
+	return false;
+}
+
+/* Append a result to the host buffer, or to the region of the partition of its record */
+static bool __write(struct filter_ctx *ctx, struct filter_unit *unit, const void *rec,
+		    const void *out, uint32_t size)
+{
+	struct filter_part *part;
+	uint32_t h;
+
+	if (ctx->nr_parts == 0)
+		return filter_hbuf_write(&ctx->hb, out, size);
+
+	h = jhash_1word(filter_get_column(rec, ctx->part_column), ctx->part_seed);
+	part = &ctx->parts[((uint64_t)h * ctx->nr_parts) >> 32];
+	unit->cycles += FILTER_CYCLES_PER_PART;
+
+	if (size > part->size - part->used)
+		return false;
+
+	filter_hbuf_pwrite(&ctx->hb, part->offs + part->used, out, size);
+	part->used += size;
+	part->nr_rows++;
+
+	return true;
+}
+
+static void __account_out(struct filter_ctx *ctx, struct filter_unit *unit, uint32_t size)
+{
+	unit->out_bytes += size;
+	unit->cycles += size * FILTER_CYCLES_PER_OUT_BYTE;
+	ctx->nr_out += size;
+}
+
+/*
+ * Return the positions of the selected records of a batch rather than the
+ * records. A bitmap word is written once its 64 records have been scanned,
+ * and is accounted to the unit of the last one. There must be room for it
+ * when its first record is scanned, so that it fits when it is complete.
+ */
+static bool __select(struct filter_ctx *ctx, uint64_t sel, uint32_t nr, const uint32_t *offs)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr; i++, ctx->nr_rows++) {
+		struct filter_unit *unit = filter_unit_at(ctx, offs[i]);
+		uint32_t bit = ctx->nr_rows % 64;
+		__le64 word;
+		__le32 id;
+
+		unit->cycles += ctx->rec_cycles + ctx->row_cycles[i];
+
+		if (ctx->output == NVME_FILTER_OUT_ROWIDS) {
+			if (!(sel & (1ULL << i)))
+				continue;
+
+			id = cpu_to_le32(ctx->nr_rows);
+			if (!filter_hbuf_write(&ctx->hb, &id, sizeof(id)))
+				return __stop(ctx, i);
+			__account_out(ctx, unit, sizeof(id));
+			continue;
+		}
+
+		if (bit == 0 && ctx->hb.size - ctx->hb.offs < sizeof(word))
+			return __stop(ctx, i);
+
+		if (sel & (1ULL << i))
+			ctx->sel_word |= 1ULL << bit;
+
+		if (bit == 63) {
+			word = cpu_to_le64(ctx->sel_word);
+			filter_hbuf_write(&ctx->hb, &word, sizeof(word));
+			__account_out(ctx, unit, sizeof(word));
+			ctx->sel_word = 0;
+		}
+	}
+
+	return true;
+}
+
+/* Fold the selected records of a batch into the statistics of their columns */
+static bool __fold_stats(struct filter_ctx *ctx, const void *rows, uint32_t nr,
+			 const uint32_t *offs, uint64_t sel)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr; i++) {
+		struct filter_unit *unit = filter_unit_at(ctx, offs[i]);
+		const void *rec = rows + i * ctx->rec_size;
+
+		unit->cycles += ctx->rec_cycles + ctx->row_cycles[i];
+		if (!(sel & (1ULL << i)))
+			continue;
+		ctx->nr_matched++;
+
+		filter_stats_fold(&ctx->stats, rec,
+				  ctx->nr_columns ? filter_get_column(rec, ctx->nr_columns) : 0);
+		unit->cycles += ctx->fold_cycles;
+	}
+
+	return true;
+}
+
+/* The records of a batch that are in the sample */
+static uint64_t __sample(struct filter_ctx *ctx, uint32_t nr, const uint32_t *offs)
+{
+	uint64_t mask = 0;
+	uint32_t i;
+
+	for (i = 0; i < nr; i++) {
+		if (ctx->sample == NVME_FILTER_SAMPLE_PAGES) {
+			if (!filter_unit_at(ctx, offs[i])->unsampled)
+				mask |= 1ULL << i;
+			continue;
+		}
+
+		if (offs[i] == ctx->sample_offs)
+			ctx->sample_dup++;
+		else if (ctx->sample_offs != U32_MAX)
+			ctx->sample_dup = 0;
+		ctx->sample_offs = offs[i];
+
+		if (__sampled(ctx, ctx->scan_offs + offs[i], ctx->sample_dup))
+			mask |= 1ULL << i;
+	}
+
+	return mask;
+}
+
+/*
+ * Copy the records selected by @sel, or their projected columns, to the
+ * host buffer. The work done for record i is accounted to the unit holding
+ * byte @offs[i] of the scanned range. Returns false once the host buffer is
+ * full.
+ */
+bool filter_emit_rows(struct filter_ctx *ctx, const void *rows, uint32_t nr, const uint32_t *offs,
+		      uint64_t sel)
+{
+	uint8_t tuple[NVME_FILTER_MAX_PROJ * NVME_FILTER_COLUMN_SIZE];
+	uint32_t i;
+
+	if (ctx->sample)
+		sel &= __sample(ctx, nr, offs);
+
+	if (ctx->output == NVME_FILTER_OUT_STATS)
+		return __fold_stats(ctx, rows, nr, offs, sel);
+
+	if (ctx->output != NVME_FILTER_OUT_ROWS)
+		return __select(ctx, sel, nr, offs);
+
+	for (i = 0; i < nr; i++) {
+		struct filter_unit *unit = filter_unit_at(ctx, offs[i]);
+		const void *rec = rows + i * ctx->rec_size;
+		const void *out = rec;
+		uint32_t out_size = ctx->out_size;
+
+		unit->cycles += ctx->rec_cycles + ctx->row_cycles[i];
+		if (!(sel & (1ULL << i)))
+			continue;
+		ctx->nr_matched++;
+
+		if (ctx->topk.k) {
+			__keep(ctx, unit, rec);
+			continue;
+		}
+
+		if (ctx->nr_aggs) {
+			unit->cycles += ctx->fold_cycles;
+			if (__fold(ctx, rec))
+				continue;
+
+			/* the next command of a stream starts over with an empty table */
+			if (ctx->stream)
+				return __stop(ctx, i);
+
+			/* spill the record to the host, which aggregates it itself */
+			out_size = ctx->rec_size;
+
+			/* ahead of the groups, which must all still fit */
+			if (ctx->hb.offs + out_size + ctx->groups.nr_groups * __group_size(ctx) >
+			    ctx->hb.size)
+				return __stop(ctx, i);
+		} else if (ctx->nr_proj) {
+			__project(ctx, rec, tuple);
+			out = tuple;
+		}
+
+		if (!__write(ctx, unit, rec, out, out_size))
+			return __stop(ctx, i);
+
+		if (ctx->nr_aggs)
+			ctx->nr_spilled += out_size;
+
+		__account_out(ctx, unit, out_size);
+	}
+
+	return true;
+}
+
+/* Evaluate the predicates against up to FILTER_BATCH records and emit the matching ones */
+bool filter_scan_rows(struct filter_ctx *ctx, const void *rows, uint32_t nr, const uint32_t *offs)
+{
+	return filter_emit_rows(ctx, rows, nr, offs, filter_eval_rows(ctx, rows, nr));
+}
+
+/*
+ * Filter the records in [data, data + len), the bytes of the namespace from
+ * ctx->scan_offs on, and work out where a streaming command resumes.
+ */
+void filter_scan(struct filter_ctx *ctx, const void *data, size_t len)
+{
+	size_t pos = filter_formats[ctx->format]->scan(ctx, data, len);
+	uint64_t end = ctx->scan_offs + len - ctx->extent_offs;
+	uint64_t cursor = ctx->scan_offs - ctx->extent_offs + pos;
+
+	if (!ctx->stream)
+		return;
+
+	/* not even the first result fit */
+	ctx->stalled = ctx->full && cursor == ctx->cursor;
+
+	if (!ctx->full && end == ctx->extent_len)
+		ctx->cursor = NVME_FILTER_CURSOR_DONE;
+	else
+		ctx->cursor = cursor;
+}
+
+static bool __emit_aggs(struct filter_ctx *ctx, struct filter_acc *accs)
+{
+	uint32_t i;
+
+	for (i = 0; i < ctx->nr_aggs; i++) {
+		struct nvme_filter_agg_result res = {
+			.value = cpu_to_le64(filter_acc_value(&ctx->aggs[i], &accs[i])),
+			.count = cpu_to_le64(accs[i].count),
+		};
+
+		if (!filter_hbuf_write(&ctx->hb, &res, sizeof(res)))
+			return false;
+		ctx->nr_tail += sizeof(res);
+	}
+
+	return true;
+}
+
+static bool __emit_group(struct filter_ctx *ctx, struct filter_group *group)
+{
+	__le32 keys[NVME_FILTER_MAX_GROUP_KEYS + 1] = { 0 };
+	uint32_t i, keys_size = ALIGN((ctx->nr_group_keys + 1) * sizeof(keys[0]), sizeof(__le64));
+
+	/* the keys and the bitmap of the NULL ones */
+	for (i = 0; i <= ctx->nr_group_keys; i++)
+		keys[i] = cpu_to_le32(group->keys[i]);
+
+	if (!filter_hbuf_write(&ctx->hb, keys, keys_size))
+		return false;
+	ctx->nr_tail += keys_size;
+
+	return __emit_aggs(ctx, group->accs);
+}
+
+/*
+ * Return the records kept by Top-K, first to last. They are popped last to
+ * first and written backwards, dropping the last ones if they do not fit.
+ */
+static void __emit_topk(struct filter_ctx *ctx)
+{
+	struct filter_topk *topk = &ctx->topk;
+	size_t size = topk->tuple_size, base = ctx->hb.offs;
+	uint32_t nr = min_t(size_t, topk->nr_entries, (ctx->hb.size - base) / size);
+	uint32_t i;
+
+	for (i = topk->nr_entries; i > nr; i--)
+		filter_topk_pop(topk);
+
+	for (i = nr; i > 0; i--)
+		filter_hbuf_pwrite(&ctx->hb, base + (i - 1) * size, filter_topk_pop(topk), size);
+
+	ctx->hb.offs += nr * size;
+	ctx->nr_tail += nr * size;
+}
+
+/* Each region starts with the size of its partition */
+static uint32_t __emit_parts(struct filter_ctx *ctx)
+{
+	uint32_t i, nr_rows = 0;
+
+	for (i = 0; i < ctx->nr_parts; i++) {
+		struct filter_part *part = &ctx->parts[i];
+		struct nvme_filter_part_hdr hdr = {
+			.nr_bytes = cpu_to_le32(part->used - sizeof(hdr)),
+			.nr_rows = cpu_to_le32(part->nr_rows),
+		};
+
+		filter_hbuf_pwrite(&ctx->hb, part->offs, &hdr, sizeof(hdr));
+		ctx->nr_tail += sizeof(hdr);
+		nr_rows += part->nr_rows;
+	}
+
+	return nr_rows;
+}
+
+/* The statistics of each column, followed by the bounds of its histogram */
+static void __emit_stats(struct filter_ctx *ctx)
+{
+	struct filter_stats *stats = &ctx->stats;
+	size_t hdr_size = offsetof(struct nvme_filter_stats, hll);
+	size_t bounds_size = stats->entry_size - sizeof(struct nvme_filter_stats);
+	__le32 bounds[NVME_FILTER_MAX_BUCKETS + 2];
+	uint32_t i;
+
+	for (i = 0; i < stats->nr_cols; i++) {
+		struct filter_col_stats *cs = &stats->cols[i];
+		struct nvme_filter_stats res = {
+			.column = cpu_to_le16(cs->column),
+			.nr_values = cpu_to_le64(cs->nr_values),
+			.nr_nulls = cpu_to_le64(cs->nr_nulls),
+			.nr_distinct = cpu_to_le64(filter_stats_distinct(cs)),
+			.min = cpu_to_le32(cs->min),
+			.max = cpu_to_le32(cs->max),
+		};
+
+		if (ctx->hb.size - ctx->hb.offs < stats->entry_size)
+			break;
+
+		memset(bounds, 0, bounds_size);
+		res.nr_bounds = cpu_to_le16(filter_stats_bounds(cs, stats->nr_buckets, bounds,
+								 &ctx->tail_cycles));
+
+		filter_hbuf_write(&ctx->hb, &res, hdr_size);
+		filter_hbuf_write(&ctx->hb, cs->regs, NVME_FILTER_HLL_REGS);
+		filter_hbuf_write(&ctx->hb, bounds, bounds_size);
+		ctx->nr_tail += stats->entry_size;
+	}
+}
+
+/* How many pages were scanned, and how many of them are in the sample */
+static void __emit_sample(struct filter_ctx *ctx)
+{
+	struct nvme_filter_sample_hdr hdr;
+	uint64_t nr = ctx->nr_units, nr_sampled = 0, i;
+
+	/* nothing past the cursor has been read */
+	if (ctx->stream && ctx->cursor != NVME_FILTER_CURSOR_DONE)
+		nr = min(nr, (ctx->unit_offs + ctx->extent_offs + ctx->cursor - ctx->scan_offs) /
+				     ctx->unit_size + 1);
+
+	for (i = 0; i < nr; i++)
+		nr_sampled += !ctx->units[i].unsampled;
+
+	hdr.nr_pages = cpu_to_le64(nr);
+	hdr.nr_sampled = cpu_to_le64(nr_sampled);
+	filter_hbuf_pwrite(&ctx->hb, ctx->stream ? sizeof(struct nvme_filter_stream_hdr) : 0, &hdr,
+			   sizeof(hdr));
+	ctx->nr_tail += sizeof(hdr);
+}
+
+/* The results go to the header of the host buffer, and the cursor to the completion */
+static uint32_t __finish_stream(struct filter_ctx *ctx)
+{
+	struct nvme_filter_stream_hdr hdr = {
+		.result0 = cpu_to_le32(ctx->result0),
+		.result1 = cpu_to_le32(ctx->result1),
+		.nr_bytes = cpu_to_le64(ctx->nr_out),
+	};
+
+	if (ctx->stalled)
+		return NVME_SC_CAP_EXCEEDED;
+
+	filter_hbuf_pwrite(&ctx->hb, 0, &hdr, sizeof(hdr));
+	ctx->nr_tail += sizeof(hdr);
+	ctx->nr_out += sizeof(hdr);
+	ctx->tail_cycles += sizeof(hdr) * FILTER_CYCLES_PER_OUT_BYTE;
+
+	ctx->result0 = lower_32_bits(ctx->cursor);
+	ctx->result1 = upper_32_bits(ctx->cursor);
+
+	return NVME_SC_SUCCESS;
+}
+
+/*
+ * Emit what is only known once the scan is done and set the completion
+ * results. The bytes emitted here are counted in @nr_tail, the work in
+ * @tail_cycles.
+ */
+uint32_t filter_finish(struct filter_ctx *ctx)
+{
+	struct filter_acc accs[NVME_FILTER_MAX_AGGS];
+	__le64 word = cpu_to_le64(ctx->sel_word);
+	uint32_t i;
+
+	if (ctx->output == NVME_FILTER_OUT_STATS) {
+		__emit_stats(ctx);
+		ctx->result0 = ctx->nr_tail;
+		ctx->result1 = ctx->nr_matched;
+	} else if (ctx->output != NVME_FILTER_OUT_ROWS) {
+		/* the bytes of the last bitmap word that cover records */
+		if (ctx->output == NVME_FILTER_OUT_BITMAP && ctx->nr_rows % 64) {
+			ctx->nr_tail = DIV_ROUND_UP(ctx->nr_rows % 64, 8);
+			filter_hbuf_write(&ctx->hb, &word, ctx->nr_tail);
+		}
+		ctx->result0 = ctx->nr_out + ctx->nr_tail;
+		ctx->result1 = ctx->nr_rows;
+	} else if (ctx->topk.k) {
+		__emit_topk(ctx);
+		ctx->result0 = ctx->nr_tail;
+		ctx->result1 = ctx->nr_matched;
+	} else if (ctx->nr_parts) {
+		/* the other partitions would miss the records past the one that did not fit */
+		if (ctx->full && !ctx->stream) {
+			NVMEV_ERROR("%s: no room left in a partition\n", __func__);
+			return NVME_SC_CAP_EXCEEDED;
+		}
+		ctx->result1 = __emit_parts(ctx);
+		ctx->result0 = ctx->nr_out;
+	} else if (ctx->nr_aggs == 0) {
+		/* the host could not tell the records returned from all of them */
+		if (ctx->full && !ctx->stream) {
+			NVMEV_ERROR("%s: no room left for the matching records\n", __func__);
+			return NVME_SC_CAP_EXCEEDED;
+		}
+		ctx->result0 = ctx->nr_out;
+	} else if (ctx->nr_group_keys == 0) {
+		for (i = 0; i < ctx->nr_aggs; i++)
+			accs[i] = ctx->aggs[i].acc;
+
+		__emit_aggs(ctx, accs);
+		ctx->result0 = lower_32_bits(filter_acc_value(&ctx->aggs[0], &accs[0]));
+		ctx->result1 = upper_32_bits(filter_acc_value(&ctx->aggs[0], &accs[0]));
+	} else {
+		/* the groups would miss the records neither folded nor spilled */
+		if (ctx->full && !ctx->stream) {
+			NVMEV_ERROR("%s: no room left for the spilled records\n", __func__);
+			return NVME_SC_CAP_EXCEEDED;
+		}
+
+		for (i = 0; i < ctx->groups.nr_groups; i++) {
+			if (!__emit_group(ctx, filter_groups_entry(&ctx->groups, i)))
+				return NVME_SC_CAP_EXCEEDED;
+		}
+		ctx->result0 = i;
+		ctx->result1 = ctx->nr_spilled;
+	}
+
+	if (ctx->sample)
+		__emit_sample(ctx);
+
+	ctx->nr_out += ctx->nr_tail;
+	ctx->tail_cycles += ctx->nr_tail * FILTER_CYCLES_PER_OUT_BYTE;
+
+	if (ctx->stream)
+		return __finish_stream(ctx);
+
+	return NVME_SC_SUCCESS;
+}
@@ -0,0 +1,559 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef _NVMEVIRT_FILTER_H
+#define _NVMEVIRT_FILTER_H
+
+#include <linux/kref.h>
+#include <linux/types.h>
+#include "nvmev.h"
+#include "nvme_filter.h"
+#include "pqueue/pqueue.h"
+
+/* a single "column <op> constant" predicate */
+struct filter_pred {
+	uint32_t column;
+	uint32_t op;
+	int32_t value;
+	int32_t high; /* upper bound of BETWEEN */
+	bool new_term; /* starts a new OR term */
+};
+
+/* predicates in disjunctive normal form, evaluated per record */
+struct filter_prog {
+	uint32_t nr_preds;
+	struct filter_pred preds[NVME_FILTER_MAX_CLAUSES];
+};
+
+/*
+ * host buffer described by the PRP entries of a command, accessed
+ * sequentially. Its pages, and those of the PRP list, are only mapped while
+ * they are copied to or from.
+ */
+struct filter_hbuf {
+	uint64_t prp1;
+	uint64_t prp2;
+	bool prp_list; /* PRP2 points to a PRP list */
+	size_t size;
+	size_t offs;
+};
+
+void filter_hbuf_init(struct filter_hbuf *hb, uint64_t prp1, uint64_t prp2, size_t size);
+bool filter_hbuf_write(struct filter_hbuf *hb, const void *src, size_t len);
+bool filter_hbuf_read(struct filter_hbuf *hb, void *dst, size_t len);
+bool filter_hbuf_pwrite(struct filter_hbuf *hb, size_t offs, const void *src, size_t len);
+void filter_host_read(uint64_t paddr, void *dst, size_t len);
+
+static inline int32_t filter_get_column(const void *rec, uint32_t column)
+{
+	__le32 v;
+
+	/* records are packed, so columns need not be aligned */
+	memcpy(&v, rec + column * NVME_FILTER_COLUMN_SIZE, sizeof(v));
+	return (int32_t)le32_to_cpu(v);
+}
+
+static inline bool filter_cmp(int32_t v, const struct filter_pred *pred)
+{
+	int32_t value = pred->value;
+
+	switch (pred->op) {
+	case NVME_FILTER_OP_EQ:
+		return v == value;
+	case NVME_FILTER_OP_NE:
+		return v != value;
+	case NVME_FILTER_OP_LT:
+		return v < value;
+	case NVME_FILTER_OP_LE:
+		return v <= value;
+	case NVME_FILTER_OP_GT:
+		return v > value;
+	case NVME_FILTER_OP_GE:
+		return v >= value;
+	case NVME_FILTER_OP_BETWEEN:
+		return v >= value && v <= pred->high;
+	}
+
+	return false;
+}
+
+#define FILTER_BATCH (64) /* records evaluated per selection bitmap */
+#define FILTER_PG_EPOCH_DAYS (10957) /* from 1970-01-01 to 2000-01-01 */
+
+/* predicate kernels, see filter_simd.c */
+struct filter_kernels {
+	const char *name;
+	bool fpu; /* must run between kernel_fpu_begin() and kernel_fpu_end() */
+	uint64_t (*cmp_i32)(const void *recs, uint32_t nr, uint32_t rec_size,
+			    const struct filter_pred *pred);
+	/* bit i set if @lo <= codes[i] <= @hi */
+	uint64_t (*range_u8)(const uint8_t *codes, uint32_t nr, uint8_t lo, uint8_t hi);
+	/* offset of the first occurrence of @needle in @s, -1 if there is none */
+	int32_t (*find)(const char *s, uint32_t len, const char *needle, uint32_t nlen);
+};
+
+extern const struct filter_kernels *filter_kernels;
+extern const struct filter_kernels filter_kernels_avx2;
+void filter_select_kernels(void);
+uint64_t filter_cmp_i32_scalar(const void *recs, uint32_t nr, uint32_t rec_size,
+			       const struct filter_pred *pred);
+uint64_t filter_range_u8_scalar(const uint8_t *codes, uint32_t nr, uint8_t lo, uint8_t hi);
+int32_t filter_find_scalar(const char *s, uint32_t len, const char *needle, uint32_t nlen);
+
+/* running state of an aggregate */
+struct filter_acc {
+	int64_t value;
+	uint64_t count;
+};
+
+/* an aggregate and its accumulator when not grouping */
+struct filter_agg {
+	uint32_t func;
+	uint32_t column;
+	struct filter_acc acc;
+};
+
+void filter_acc_fold(const struct filter_agg *agg, struct filter_acc *acc, const void *rec);
+int64_t filter_acc_value(const struct filter_agg *agg, const struct filter_acc *acc);
+
+/*
+ * Device memory for the operators of the filter command in progress. It is
+ * allocated once and handed out again for every command, so nothing is
+ * allocated per record.
+ */
+struct filter_arena {
+	void *base;
+	size_t size;
+	size_t used;
+};
+
+bool filter_arena_init(struct filter_arena *arena, size_t size);
+void filter_arena_exit(struct filter_arena *arena);
+void *filter_arena_alloc(struct filter_arena *arena, size_t size);
+
+static inline void filter_arena_reset(struct filter_arena *arena)
+{
+	arena->used = 0;
+}
+
+struct filter_group {
+	int32_t keys[NVME_FILTER_MAX_GROUP_KEYS + 1]; /* then the bitmap of the NULL ones */
+	struct filter_acc accs[];
+};
+
+/* open addressing hash table of groups, sized to what is left in the arena */
+struct filter_groups {
+	uint32_t nr_keys;
+	uint32_t keys[NVME_FILTER_MAX_GROUP_KEYS]; /* columns */
+	uint32_t nr_aggs;
+
+	uint32_t nr_buckets;
+	uint32_t *buckets; /* index + 1 of the group in @entries, 0 if empty */
+
+	uint32_t entry_size;
+	uint32_t max_groups;
+	uint32_t nr_groups;
+	void *entries;
+};
+
+bool filter_groups_init(struct filter_groups *groups, struct filter_arena *arena,
+			uint32_t nr_keys, const uint32_t *keys, uint32_t nr_aggs);
+struct filter_group *filter_groups_get(struct filter_groups *groups, const void *rec,
+				       uint32_t nulls);
+
+static inline struct filter_group *filter_groups_entry(struct filter_groups *groups, uint32_t i)
+{
+	return groups->entries + (size_t)i * groups->entry_size;
+}
+
+/*
+ * The top K records by a column, kept in a heap of entries allocated from
+ * the arena whose root is the one to be evicted first, see filter_topk.c.
+ */
+struct filter_topk_entry {
+	pqueue_pri_t pri;
+	size_t pos;
+	uint8_t tuple[];
+};
+
+struct filter_topk {
+	uint32_t k; /* 0 if disabled */
+	uint32_t column;
+	bool desc;
+	uint32_t tuple_size;
+	uint32_t entry_size;
+	uint32_t nr_entries;
+	void *entries;
+	pqueue_t *heap;
+};
+
+bool filter_topk_init(struct filter_topk *topk, struct filter_arena *arena, uint32_t k,
+		      uint32_t column, bool desc, uint32_t tuple_size);
+void filter_topk_free(struct filter_topk *topk);
+pqueue_pri_t filter_topk_pri(int32_t v, bool null);
+void *filter_topk_slot(struct filter_topk *topk, pqueue_pri_t pri);
+const void *filter_topk_pop(struct filter_topk *topk);
+
+/*
+ * Statistics of a column, in memory allocated from the arena whatever the
+ * number of records, see filter_stats.c
+ */
+struct filter_col_stats {
+	uint32_t column;
+	int32_t min;
+	int32_t max;
+	uint64_t nr_values; /* not NULL */
+	uint64_t nr_nulls;
+	int32_t *sample; /* FILTER_STATS_SAMPLE_SIZE values, the first nr_values until full */
+	uint8_t *regs; /* NVME_FILTER_HLL_REGS HyperLogLog registers */
+};
+
+struct filter_stats {
+	uint32_t nr_cols;
+	uint32_t nr_buckets; /* of the histograms, 0 for none */
+	uint32_t entry_size; /* bytes returned per column */
+	struct filter_col_stats *cols;
+};
+
+bool filter_stats_init(struct filter_stats *stats, struct filter_arena *arena, uint32_t nr_cols,
+		       const uint16_t *cols, uint32_t nr_buckets);
+void filter_stats_fold(struct filter_stats *stats, const void *rec, uint32_t nulls);
+uint64_t filter_stats_distinct(const struct filter_col_stats *cs);
+uint32_t filter_stats_bounds(struct filter_col_stats *cs, uint32_t nr_buckets, __le32 *bounds,
+			     uint64_t *cycles);
+
+#define FILTER_ZM_MAX_COLUMNS (4)
+
+struct filter_zone {
+	int32_t min;
+	int32_t max;
+};
+
+/*
+ * Per logical page min/max of the columns registered through module
+ * parameters, for a table of records laid out from the start of the
+ * namespace. A page is described by the records that overlap it.
+ * Optionally, a Bloom filter per page holds the values of all these
+ * columns to rule out pages for equality predicates.
+ */
+struct filter_zonemap {
+	uint32_t rec_size; /* 0 if disabled */
+	uint32_t nr_cols;
+	uint32_t cols[FILTER_ZM_MAX_COLUMNS];
+
+	uint32_t pgsz;
+	uint64_t nr_pgs;
+	struct filter_zone *zones; /* nr_cols entries per page */
+
+	uint32_t bloom_words; /* 64-bit words per page, 0 if disabled */
+	uint32_t bloom_hashes;
+	uint64_t *blooms;
+};
+
+static inline bool filter_zonemap_enabled(struct filter_zonemap *zm)
+{
+	return zm->rec_size != 0;
+}
+
+void filter_zonemap_init(struct filter_zonemap *zm, uint64_t nr_pgs, uint32_t pgsz);
+void filter_zonemap_exit(struct filter_zonemap *zm);
+void filter_zonemap_update(struct filter_zonemap *zm, const void *mapped, uint64_t offs,
+			   uint64_t len);
+bool filter_zonemap_may_match(struct filter_zonemap *zm, struct filter_prog *prog, uint64_t lpn);
+
+/* a Bloom filter loaded by the host, see filter_bloom.c */
+struct filter_bloom {
+	struct kref ref;
+	size_t size;
+	uint32_t nr_bits;
+	uint32_t nr_hashes;
+	uint32_t seed;
+	uint64_t bits[];
+};
+
+uint32_t filter_bloom_load(uint64_t prp1, uint64_t prp2, uint32_t *id);
+uint32_t filter_bloom_drop(uint32_t id);
+struct filter_bloom *filter_bloom_get(uint32_t id);
+void filter_bloom_put(struct filter_bloom *bloom);
+void filter_blooms_exit(void);
+uint64_t filter_bloom_test(const struct filter_bloom *bloom, const void *recs, uint32_t nr,
+			   uint32_t rec_size, uint32_t column);
+
+/* the pages a recent filter command read and when it sensed them, see filter_shared.c */
+struct filter_shared_scan {
+	uint64_t start_lpn;
+	uint32_t nr_pgs;
+	uint64_t nsecs_end; /* when it sensed its last page */
+	uint64_t *nsecs_sensed; /* per page, 0 if it did not read it */
+};
+
+struct filter_shared {
+	uint32_t max_pgs; /* of a scan, 0 if disabled */
+	struct filter_shared_scan scans[FILTER_SHARED_SCANS];
+	uint64_t *pending; /* of the command in progress */
+};
+
+bool filter_shared_init(struct filter_shared *shared, uint32_t max_pgs);
+void filter_shared_exit(struct filter_shared *shared);
+uint64_t *filter_shared_begin(struct filter_shared *shared, uint32_t nr_pgs);
+void filter_shared_end(struct filter_shared *shared, uint64_t start_lpn, uint32_t nr_pgs);
+uint64_t filter_shared_sensed(struct filter_shared *shared, uint64_t lpn, uint64_t nsecs);
+void filter_shared_drop(struct filter_shared *shared, uint64_t start_lpn, uint64_t end_lpn);
+
+/* work done for the records starting in a mapping unit of the scanned range */
+struct filter_unit {
+	uint32_t out_bytes; /* bytes returned to the host */
+	uint32_t cycles; /* controller core cycles spent */
+	bool unsampled; /* out of a page sample, not read */
+};
+
+struct filter_column {
+	uint8_t type; /* enum nvme_filter_type */
+	uint8_t scale;
+};
+
+#define FILTER_LIKE_MAX_SEGS (8)
+
+/* a LIKE pattern split at its '%', see filter_like.c */
+struct filter_like_seg {
+	uint8_t offs; /* in the pattern */
+	uint8_t len;
+	bool any; /* holds a '_' */
+};
+
+struct filter_like {
+	uint32_t column;
+	bool anchor_start; /* the first segment starts the value */
+	bool anchor_end; /* the last segment ends it */
+	uint32_t nr_segs;
+	struct filter_like_seg segs[FILTER_LIKE_MAX_SEGS];
+	char pattern[NVME_FILTER_MAX_PATTERN_LEN];
+};
+
+/* a string value of a row, where it is stored */
+struct filter_like_val {
+	const uint8_t *s;
+	uint32_t len;
+};
+
+/* a region of the host buffer taking the records of a partition */
+struct filter_part {
+	size_t offs;
+	size_t size;
+	size_t used; /* including the header */
+	uint32_t nr_rows;
+};
+
+/*
+ * A clause on a dictionary-encoded column of the block being scanned,
+ * translated to the codes of the values that satisfy it, see filter_block.c
+ */
+struct filter_code_pred {
+	const uint8_t *codes; /* of the records of the block */
+	bool range; /* codes in [lo, hi] satisfy it, or do not if @negate */
+	bool negate;
+	uint8_t lo;
+	uint8_t hi;
+	uint64_t set[NVME_FILTER_DICT_MAX_VALUES / 64]; /* codes that satisfy it otherwise */
+	uint64_t sel; /* bit i set if row i of the batch satisfies it */
+};
+
+/* per-command state of a filter command */
+struct filter_ctx {
+	const struct nvme_filter_desc *desc; /* device copy, NULL without NVME_FILTER_FLAG_DESC */
+	struct filter_prog prog;
+	uint32_t rec_size;
+
+	/*
+	 * Records of typed formats are decoded into @rows first, a batch at
+	 * a time, with the NULL columns of each one in @nulls.
+	 */
+	uint32_t format; /* enum nvme_filter_format */
+	uint32_t nr_columns; /* 0 unless the format is typed */
+	struct filter_column columns[NVME_FILTER_MAX_COLUMNS];
+	char delim; /* field separator of text formats */
+	void *rows;
+	uint64_t nulls[NVME_FILTER_MAX_COLUMNS]; /* bit i set if column is NULL in row i */
+	void *block; /* records of a block of NVME_FILTER_FMT_BLOCKS, decompressed */
+
+	/*
+	 * Clauses on the dictionary-encoded columns of a block are evaluated
+	 * on the codes. Bit N of @code_preds is set if clause N is, and
+	 * @code, one per clause, is only allocated for NVME_FILTER_FMT_BLOCKS.
+	 */
+	uint32_t code_preds;
+	struct filter_code_pred *code;
+
+	/*
+	 * LIKE clauses are matched on the values recorded while decoding, as
+	 * the rows only hold the prefix of strings. @like_vals[k][i] is the
+	 * value of the column of @likes[k] in row i of the batch, bit i of
+	 * @like_sel[k] is set if it matches, and @row_cycles[i] is the work
+	 * it took.
+	 */
+	uint32_t nr_likes;
+	uint32_t like_cols; /* bit N set if column N has LIKE clauses */
+	struct filter_like likes[NVME_FILTER_MAX_PATTERNS];
+	struct filter_like_val like_vals[NVME_FILTER_MAX_PATTERNS][FILTER_BATCH];
+	uint64_t like_sel[NVME_FILTER_MAX_PATTERNS];
+	uint32_t row_cycles[FILTER_BATCH];
+
+	/* Bloom filters tested by NVME_FILTER_OP_IN_BLOOM clauses, by id */
+	struct filter_bloom *blooms[NVME_FILTER_MAX_BLOOMS];
+	uint32_t nr_probes; /* such clauses */
+
+	/* columns copied to the output, whole records if nr_proj is 0 */
+	uint32_t nr_proj;
+	uint16_t proj[NVME_FILTER_MAX_PROJ];
+	uint32_t out_size; /* bytes returned per matching record */
+
+	/* matching records are folded into these instead of being returned */
+	uint32_t nr_aggs;
+	struct filter_agg aggs[NVME_FILTER_MAX_AGGS];
+
+	/*
+	 * With an output other than NVME_FILTER_OUT_ROWS, @nr_rows is the
+	 * number of the next record, and @sel_word holds the bits of the
+	 * bitmap word of records rounddown(@nr_rows, 64) on.
+	 */
+	uint32_t output; /* enum nvme_filter_output */
+	uint32_t nr_rows;
+	uint64_t sel_word;
+
+	/* per group aggregation if nr_group_keys is not 0 */
+	uint32_t nr_group_keys;
+	struct filter_groups groups;
+	uint64_t nr_spilled; /* bytes of records whose group did not fit */
+	struct filter_arena *arena;
+
+	/*
+	 * Matching records are written to @parts, allocated from the arena,
+	 * by the hash of their @part_column if @nr_parts is not 0.
+	 */
+	uint32_t nr_parts;
+	uint32_t part_column;
+	uint32_t part_seed;
+	struct filter_part *parts;
+
+	/*
+	 * Records out of the sample are left out of the selection. A page or
+	 * record is in it if its hash is below @sample_max. @sample_dup counts
+	 * the records found at @sample_offs before the current one, which the
+	 * records of a block share.
+	 */
+	uint32_t sample; /* enum nvme_filter_sample */
+	uint32_t sample_seed;
+	uint64_t sample_max;
+	uint32_t sample_offs;
+	uint32_t sample_dup;
+
+	/* statistics of the matching records with NVME_FILTER_OUT_STATS */
+	struct filter_stats stats;
+
+	/* matching records are kept in @topk if its k is not 0, and counted */
+	struct filter_topk topk;
+	uint64_t nr_matched;
+
+	/* bytes of the namespace scanned by this command */
+	uint64_t scan_offs;
+	uint64_t scan_len;
+
+	/*
+	 * A streaming command scans the part of the extent from @cursor on,
+	 * @first_item being the part of @cursor below the format's alignment.
+	 * @full tells that the scan stopped at row @stop_row of a batch,
+	 * @stalled that it did so before making any progress.
+	 */
+	bool stream;
+	uint64_t extent_offs;
+	uint64_t extent_len;
+	uint64_t cursor;
+	uint32_t first_item;
+	bool full;
+	uint32_t stop_row;
+	bool stalled;
+
+	struct filter_hbuf hb;
+	uint64_t nr_out; /* bytes written to the host buffer */
+	uint64_t nr_tail; /* bytes of those written once the scan is done */
+	uint64_t tail_cycles; /* cycles spent once the scan is done */
+	uint32_t result0;
+	uint32_t result1;
+
+	/* cycles spent on each record, and on each one that matches and is folded */
+	uint32_t rec_cycles;
+	uint32_t fold_cycles;
+
+	/* @unit_offs is the offset of the scanned range in its first unit */
+	uint32_t unit_size;
+	uint32_t unit_offs;
+	uint32_t nr_units;
+	struct filter_unit *units;
+};
+
+uint32_t filter_ctx_init(struct filter_ctx *ctx, struct nvme_filter_command *cmd,
+			 struct nvme_filter_desc *desc, struct filter_arena *arena,
+			 uint32_t unit_size, uint64_t ns_size);
+void filter_ctx_free(struct filter_ctx *ctx);
+
+static inline struct filter_unit *filter_unit_at(struct filter_ctx *ctx, size_t offs)
+{
+	return &ctx->units[(ctx->unit_offs + offs) / ctx->unit_size];
+}
+
+/* table catalog, see filter_catalog.c */
+uint32_t filter_table_register(uint32_t nsid, uint64_t prp1, uint64_t prp2, uint32_t *id);
+uint32_t filter_table_unregister(uint32_t id);
+bool filter_table_get(uint32_t id, struct nvme_filter_table *table);
+void filter_table_log(struct nvme_filter_table_log *log);
+
+bool filter_zonemap_applies(struct filter_zonemap *zm, struct filter_ctx *ctx, uint64_t offs);
+bool filter_scan_rows(struct filter_ctx *ctx, const void *rows, uint32_t nr, const uint32_t *offs);
+uint64_t filter_eval_rows(struct filter_ctx *ctx, const void *rows, uint32_t nr);
+bool filter_emit_rows(struct filter_ctx *ctx, const void *rows, uint32_t nr, const uint32_t *offs,
+		      uint64_t sel);
+void filter_scan(struct filter_ctx *ctx, const void *data, size_t len);
+
+/*
+ * Record formats, see filter_format.c. A format walks the scanned bytes and
+ * hands the records it finds to filter_scan_rows(), FILTER_BATCH at a time.
+ * It returns the position to resume from: the offset of the first record
+ * not scanned, plus the index of the record in its block for formats whose
+ * cursor is aligned to blocks.
+ */
+struct filter_format {
+	const char *name;
+	bool typed; /* records are decoded into rows of the descriptor's columns */
+	uint32_t cursor_align;
+	size_t (*scan)(struct filter_ctx *ctx, const void *data, size_t len);
+};
+
+extern const struct filter_format filter_format_flat;
+extern const struct filter_format filter_format_pgheap;
+extern const struct filter_format filter_format_text;
+extern const struct filter_format filter_format_blocks;
+extern const struct filter_format *const filter_formats[NVME_FILTER_FMT_NR];
+
+bool filter_format_valid(const struct nvme_filter_table *layout);
+
+/* helpers of the typed formats to build a batch of rows in ctx->rows */
+static inline void filter_row_put(struct filter_ctx *ctx, uint32_t row, uint32_t column, int32_t v)
+{
+	__le32 col = cpu_to_le32(v);
+
+	memcpy(ctx->rows + row * ctx->rec_size + column * NVME_FILTER_COLUMN_SIZE, &col,
+	       sizeof(col));
+}
+
+void filter_row_finish(struct filter_ctx *ctx, uint32_t row, uint32_t nulls);
+bool filter_rows_flush(struct filter_ctx *ctx, uint32_t *nr, const uint32_t *offs);
+int32_t filter_text_prefix(const uint8_t *s, uint32_t len, bool bpchar);
+
+/* LIKE patterns, see filter_like.c */
+bool filter_like_compile(struct filter_like *like, uint32_t column, const char *pattern,
+			 uint32_t len);
+void filter_like_row(struct filter_ctx *ctx, uint32_t row, uint32_t column, const uint8_t *s,
+		     uint32_t len);
+void filter_like_batch(struct filter_ctx *ctx, uint32_t nr);
+uint32_t filter_finish(struct filter_ctx *ctx);
+
+#endif
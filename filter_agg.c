@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/vmalloc.h>
+
+#include "nvmev.h"
+#include "filter.h"
+
+void filter_acc_fold(const struct filter_agg *agg, struct filter_acc *acc, const void *rec)
+{
+	int64_t v = 0;
+
+	if (agg->func != NVME_FILTER_AGG_COUNT)
+		v = filter_get_column(rec, agg->column);
+
+	switch (agg->func) {
+	case NVME_FILTER_AGG_SUM:
+	case NVME_FILTER_AGG_AVG:
+		acc->value += v;
+		break;
+	case NVME_FILTER_AGG_MIN:
+		if (acc->count == 0 || v < acc->value)
+			acc->value = v;
+		break;
+	case NVME_FILTER_AGG_MAX:
+		if (acc->count == 0 || v > acc->value)
+			acc->value = v;
+		break;
+	}
+	acc->count++;
+}
+
+int64_t filter_acc_value(const struct filter_agg *agg, const struct filter_acc *acc)
+{
+	return agg->func == NVME_FILTER_AGG_COUNT ? acc->count : acc->value;
+}
+
+bool filter_arena_init(struct filter_arena *arena, size_t size)
+{
+	arena->base = vmalloc(size);
+	arena->size = arena->base ? size : 0;
+	arena->used = 0;
+
+	if (!arena->base) {
+		NVMEV_ERROR("%s: failed to allocate %zu bytes\n", __func__, size);
+		return false;
+	}
+
+	return true;
+}
+
+void filter_arena_exit(struct filter_arena *arena)
+{
+	vfree(arena->base);
+	arena->base = NULL;
+	arena->size = 0;
+}
+
+void *filter_arena_alloc(struct filter_arena *arena, size_t size)
+{
+	void *ptr;
+
+	size = ALIGN(size, sizeof(uint64_t));
+	if (size > arena->size - arena->used)
+		return NULL;
+
+	ptr = arena->base + arena->used;
+	arena->used += size;
+
+	return ptr;
+}
+
+bool filter_groups_init(struct filter_groups *groups, struct filter_arena *arena,
+			uint32_t nr_keys, const uint32_t *keys, uint32_t nr_aggs)
+{
+	size_t entry_size = sizeof(struct filter_group) + nr_aggs * sizeof(struct filter_acc);
+	size_t nr;
+
+	/* two buckets per group keep the probe sequences short */
+	nr = (arena->size - arena->used) / (entry_size + 2 * sizeof(uint32_t));
+	if (nr == 0)
+		return false;
+	nr = rounddown_pow_of_two(nr);
+
+	*groups = (struct filter_groups){
+		.nr_keys = nr_keys,
+		.nr_aggs = nr_aggs,
+		.nr_buckets = nr * 2,
+		.entry_size = entry_size,
+		.max_groups = nr,
+		.nr_groups = 0,
+	};
+	memcpy(groups->keys, keys, nr_keys * sizeof(keys[0]));
+
+	groups->buckets = filter_arena_alloc(arena, groups->nr_buckets * sizeof(uint32_t));
+	groups->entries = filter_arena_alloc(arena, nr * entry_size);
+	if (!groups->buckets || !groups->entries)
+		return false;
+
+	memset(groups->buckets, 0, groups->nr_buckets * sizeof(uint32_t));
+
+	return true;
+}
+
+/*
+ * Find the group of @rec, creating it if it is new. Bit i of @nulls is set
+ * if key i is NULL, which reads as 0 but is a group of its own, as in SQL.
+ * Returns NULL if the group is new and the table is full.
+ */
+struct filter_group *filter_groups_get(struct filter_groups *groups, const void *rec,
+				       uint32_t nulls)
+{
+	int32_t keys[NVME_FILTER_MAX_GROUP_KEYS + 1];
+	size_t keys_size = (groups->nr_keys + 1) * sizeof(keys[0]);
+	uint32_t i, bucket, mask = groups->nr_buckets - 1;
+	struct filter_group *group;
+
+	for (i = 0; i < groups->nr_keys; i++)
+		keys[i] = filter_get_column(rec, groups->keys[i]);
+	keys[groups->nr_keys] = nulls;
+
+	bucket = jhash2((uint32_t *)keys, groups->nr_keys + 1, 0) & mask;
+	while (groups->buckets[bucket]) {
+		group = filter_groups_entry(groups, groups->buckets[bucket] - 1);
+		if (memcmp(group->keys, keys, keys_size) == 0)
+			return group;
+
+		bucket = (bucket + 1) & mask;
+	}
+
+	if (groups->nr_groups == groups->max_groups)
+		return NULL;
+
+	group = filter_groups_entry(groups, groups->nr_groups);
+	memcpy(group->keys, keys, keys_size);
+	memset(group->accs, 0, groups->nr_aggs * sizeof(group->accs[0]));
+	groups->buckets[bucket] = ++groups->nr_groups;
+
+	return group;
+}
@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include "nvmev.h"
+#include "filter.h"
+
+/*
+ * AVX2 predicate kernels, see filter_simd.c. This file is built with
+ * -mavx2, and its functions must only be called between kernel_fpu_begin()
+ * and kernel_fpu_end() on CPUs that have it.
+ */
+
+typedef int32_t v8si __attribute__((vector_size(32)));
+typedef float v8sf __attribute__((vector_size(32)));
+typedef char v32qi __attribute__((vector_size(32), aligned(1)));
+typedef uint8_t v32qu __attribute__((vector_size(32), aligned(1)));
+
+/* lanes are all ones where the comparison holds, @h is the upper bound of BETWEEN */
+#define __VCMP(v, op, c, h)                                \
+	({                                                 \
+		typeof(v) __m = { 0 };                     \
+		switch (op) {                              \
+		case NVME_FILTER_OP_EQ:                    \
+			__m = (v) == (c);                  \
+			break;                             \
+		case NVME_FILTER_OP_NE:                    \
+			__m = (v) != (c);                  \
+			break;                             \
+		case NVME_FILTER_OP_LT:                    \
+			__m = (v) < (c);                   \
+			break;                             \
+		case NVME_FILTER_OP_LE:                    \
+			__m = (v) <= (c);                  \
+			break;                             \
+		case NVME_FILTER_OP_GT:                    \
+			__m = (v) > (c);                   \
+			break;                             \
+		case NVME_FILTER_OP_GE:                    \
+			__m = (v) >= (c);                  \
+			break;                             \
+		case NVME_FILTER_OP_BETWEEN:               \
+			__m = ((v) >= (c)) & ((v) <= (h)); \
+			break;                             \
+		}                                          \
+		__m;                                       \
+	})
+
+static uint64_t __cmp_i32_avx2(const void *recs, uint32_t nr, uint32_t rec_size,
+			       const struct filter_pred *pred)
+{
+	const void *col = recs + pred->column * NVME_FILTER_COLUMN_SIZE;
+	v8si idx = (v8si){ 0, 1, 2, 3, 4, 5, 6, 7 } * (int32_t)rec_size;
+	v8si all = (v8si){ 0 } - 1;
+	v8si c = (v8si){ 0 } + pred->value;
+	v8si h = (v8si){ 0 } + pred->high;
+	uint64_t sel = 0;
+	uint32_t i;
+
+	for (i = 0; i + 8 <= nr; i += 8, col += 8 * rec_size) {
+		/* gather the column of eight records, @idx is in bytes */
+		v8si v = __builtin_ia32_gathersiv8si(c, col, idx, all, 1);
+
+		sel |= (uint64_t)__builtin_ia32_movmskps256((v8sf)__VCMP(v, pred->op, c, h)) << i;
+	}
+
+	if (i < nr)
+		sel |= filter_cmp_i32_scalar(recs + i * rec_size, nr - i, rec_size, pred) << i;
+
+	return sel;
+}
+
+/* codes in [lo, hi] are those whose distance above @lo is at most hi - lo, unsigned */
+static uint64_t __range_u8_avx2(const uint8_t *codes, uint32_t nr, uint8_t lo, uint8_t hi)
+{
+	v32qu l = (v32qu){ 0 } + lo;
+	v32qu w = (v32qu){ 0 } + (uint8_t)(hi - lo);
+	uint64_t sel = 0;
+	uint32_t i;
+
+	for (i = 0; i + 32 <= nr; i += 32) {
+		v32qu v = *(const v32qu *)(codes + i);
+
+		sel |= (uint64_t)(uint32_t)__builtin_ia32_pmovmskb256((v32qi)(v - l <= w)) << i;
+	}
+
+	if (i < nr)
+		sel |= filter_range_u8_scalar(codes + i, nr - i, lo, hi) << i;
+
+	return sel;
+}
+
+/* The first of the positions in @mask, where its first and last bytes are, that holds @needle */
+static int32_t __find_verify(const char *s, const char *needle, uint32_t nlen, uint32_t i,
+			     uint32_t mask)
+{
+	for (; mask; mask &= mask - 1) {
+		uint32_t pos = i + __builtin_ctz(mask);
+
+		if (nlen <= 2 || memcmp(s + pos + 1, needle + 1, nlen - 2) == 0)
+			return pos;
+	}
+
+	return -1;
+}
+
+static int32_t __find_avx2(const char *s, uint32_t len, const char *needle, uint32_t nlen)
+{
+	v32qi first, last;
+	uint32_t i;
+	int32_t found;
+
+	if (nlen == 0)
+		return 0;
+
+	first = (v32qi){ 0 } + needle[0];
+	last = (v32qi){ 0 } + needle[nlen - 1];
+
+	for (i = 0; i + nlen - 1 + 32 <= len; i += 32) {
+		v32qi a = *(const v32qi *)(s + i);
+		v32qi b = *(const v32qi *)(s + i + nlen - 1);
+		uint32_t mask = __builtin_ia32_pmovmskb256((a == first) & (b == last));
+
+		found = __find_verify(s, needle, nlen, i, mask);
+		if (found >= 0)
+			return found;
+	}
+
+	/* the rest once fewer than a vector of positions are left */
+	found = filter_find_scalar(s + i, len - i, needle, nlen);
+
+	return found < 0 ? found : found + i;
+}
+
+const struct filter_kernels filter_kernels_avx2 = {
+	.name = "avx2",
+	.fpu = true,
+	.cmp_i32 = __cmp_i32_avx2,
+	.range_u8 = __range_u8_avx2,
+	.find = __find_avx2,
+};
@@ -0,0 +1,307 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <linux/lz4.h>
+#include <asm/fpu/api.h>
+
+#include "nvmev.h"
+#include "filter.h"
+
+/*
+ * Blocks of fixed-width records, stored as is, LZ4 compressed or with
+ * dictionary-encoded columns. A compressed block is decompressed into
+ * ctx->block before its records are evaluated, which cannot start before
+ * the whole block has been read: all the work done for a block is
+ * accounted to the unit holding its last byte.
+ *
+ * The encoded columns of a block are not decoded up front. The clauses on
+ * them are translated once per block to the codes of the dictionary values
+ * that satisfy them and evaluated on the codes, and only the records that
+ * are returned have their encoded columns decoded.
+ */
+
+/*
+ * Translate clause @i on a column encoded with the @nr_values sorted
+ * @values to the codes that satisfy it. A comparison selects a range of
+ * them, an inequality all but one. Returns the cycles it took.
+ */
+static uint32_t __translate(struct filter_ctx *ctx, uint32_t i, const __le32 *values,
+			    uint32_t nr_values, const uint8_t *codes)
+{
+	struct filter_pred *pred = &ctx->prog.preds[i];
+	struct filter_code_pred *cp = &ctx->code[i];
+	uint32_t c, nr_set = 0, nr_unset = 0, lo = 0, hi = 0, nlo = 0, nhi = 0;
+	bool match;
+
+	memset(cp->set, 0, sizeof(cp->set));
+	for (c = 0; c < nr_values; c++) {
+		if (pred->op == NVME_FILTER_OP_IN_BLOOM)
+			match = filter_bloom_test(ctx->blooms[pred->value], &values[c], 1,
+						  sizeof(values[0]), 0);
+		else
+			match = filter_cmp((int32_t)le32_to_cpu(values[c]), pred);
+
+		if (match) {
+			cp->set[c / 64] |= 1ULL << (c % 64);
+			if (nr_set++ == 0)
+				lo = c;
+			hi = c;
+		} else {
+			if (nr_unset++ == 0)
+				nlo = c;
+			nhi = c;
+		}
+	}
+
+	cp->codes = codes;
+	cp->range = true;
+	cp->negate = false;
+	cp->lo = lo;
+	cp->hi = hi;
+
+	if (nr_set == 0) {
+		/* all codes but none */
+		cp->lo = 0;
+		cp->hi = U8_MAX;
+		cp->negate = true;
+	} else if (nr_set != hi - lo + 1) {
+		/* all codes but a range, or else any set of them */
+		cp->range = nr_unset == nhi - nlo + 1;
+		cp->negate = cp->range;
+		cp->lo = nlo;
+		cp->hi = nhi;
+	}
+	ctx->code_preds |= 1U << i;
+
+	if (pred->op == NVME_FILTER_OP_IN_BLOOM)
+		return nr_values * FILTER_CYCLES_PER_PROBE;
+	return nr_values * FILTER_CYCLES_PER_PRED;
+}
+
+/*
+ * Check the columns of a NVME_FILTER_CODEC_DICT payload, decode those that
+ * are not encoded into rows and translate the clauses on the others. Adds
+ * the cycles it took to @cycles. Returns false if it is malformed.
+ */
+static bool __decode_dict(struct filter_ctx *ctx, const void *p, uint32_t size, uint32_t nr_recs,
+			  uint32_t *cycles)
+{
+	uint32_t rec_size = ctx->rec_size, nr_cols = rec_size / NVME_FILTER_COLUMN_SIZE;
+	const void *end = p + size;
+	uint32_t i, col;
+
+	if (rec_size % NVME_FILTER_COLUMN_SIZE)
+		return false;
+
+	for (col = 0; col < nr_cols; col++) {
+		const struct nvme_filter_dict *dict = p;
+		uint32_t nr_values;
+		const __le32 *values;
+		const uint8_t *codes;
+
+		if (end - p < sizeof(*dict))
+			return false;
+		nr_values = le16_to_cpu(dict->nr_values);
+		values = p + sizeof(*dict);
+
+		if (nr_values == 0) {
+			if (end - (const void *)values < (size_t)nr_recs * sizeof(values[0]))
+				return false;
+
+			for (i = 0; i < nr_recs; i++)
+				memcpy(ctx->block + i * rec_size + col * NVME_FILTER_COLUMN_SIZE,
+				       &values[i], sizeof(values[0]));
+			*cycles += nr_recs * FILTER_CYCLES_PER_DICT_VALUE;
+			p = values + nr_recs;
+			continue;
+		}
+
+		codes = (const uint8_t *)(values + nr_values);
+		if (nr_values > NVME_FILTER_DICT_MAX_VALUES ||
+		    end - (const void *)codes < ALIGN(nr_recs, sizeof(__le32)))
+			return false;
+
+		for (i = 1; i < nr_values; i++) {
+			if ((int32_t)le32_to_cpu(values[i - 1]) >= (int32_t)le32_to_cpu(values[i]))
+				return false;
+		}
+
+		for (i = 0; i < nr_recs; i++) {
+			if (codes[i] >= nr_values)
+				return false;
+		}
+
+		for (i = 0; i < ctx->prog.nr_preds; i++) {
+			if (ctx->prog.preds[i].column == col)
+				*cycles += __translate(ctx, i, values, nr_values, codes);
+		}
+		p = codes + ALIGN(nr_recs, sizeof(__le32));
+	}
+
+	return true;
+}
+
+/*
+ * Decode the encoded columns of the records of a NVME_FILTER_CODEC_DICT
+ * block selected by @sel, bit i standing for record @first + i. The block
+ * has been checked already. Returns the cycles it took.
+ */
+static uint32_t __decode_codes(struct filter_ctx *ctx, const struct nvme_filter_block *blk,
+			       uint32_t first, uint64_t sel)
+{
+	uint32_t rec_size = ctx->rec_size, nr_cols = rec_size / NVME_FILTER_COLUMN_SIZE;
+	uint32_t nr_recs = le16_to_cpu(blk->nr_records);
+	uint32_t col, nr_encoded = 0;
+	const void *p = blk + 1;
+	uint64_t s;
+
+	for (col = 0; col < nr_cols; col++) {
+		const struct nvme_filter_dict *dict = p;
+		uint32_t nr_values = le16_to_cpu(dict->nr_values);
+		const __le32 *values = p + sizeof(*dict);
+		const uint8_t *codes = (const uint8_t *)(values + nr_values);
+
+		if (nr_values == 0) {
+			p = values + nr_recs;
+			continue;
+		}
+
+		for (s = sel; s; s &= s - 1) {
+			uint32_t rec = first + __builtin_ctzll(s);
+
+			memcpy(ctx->block + rec * rec_size + col * NVME_FILTER_COLUMN_SIZE,
+			       &values[codes[rec]], sizeof(values[0]));
+		}
+		nr_encoded++;
+		p = codes + ALIGN(nr_recs, sizeof(__le32));
+	}
+
+	return hweight64(sel) * nr_encoded * FILTER_CYCLES_PER_DICT_VALUE;
+}
+
+/* Evaluate the clauses on codes for the @nr records of the block from @first on */
+static void __eval_codes(struct filter_ctx *ctx, uint32_t first, uint32_t nr)
+{
+	const struct filter_kernels *k = filter_kernels;
+	uint64_t all = nr < 64 ? (1ULL << nr) - 1 : ~0ULL;
+	uint32_t i, j;
+
+	if (k->fpu)
+		kernel_fpu_begin();
+
+	for (i = 0; i < ctx->prog.nr_preds; i++) {
+		struct filter_code_pred *cp = &ctx->code[i];
+		const uint8_t *codes = cp->codes + first;
+		uint64_t sel = 0;
+
+		if (!(ctx->code_preds & (1U << i)))
+			continue;
+
+		if (cp->range) {
+			sel = k->range_u8(codes, nr, cp->lo, cp->hi);
+		} else {
+			for (j = 0; j < nr; j++) {
+				if (cp->set[codes[j] / 64] & (1ULL << (codes[j] % 64)))
+					sel |= 1ULL << j;
+			}
+		}
+		cp->sel = cp->negate ? ~sel & all : sel;
+	}
+
+	if (k->fpu)
+		kernel_fpu_end();
+}
+
+/*
+ * The records of @blk, decompressed into ctx->block unless they are stored
+ * as is, and the cycles it took in @cycles. Returns NULL if the block is
+ * malformed.
+ */
+static const void *__decode(struct filter_ctx *ctx, const struct nvme_filter_block *blk,
+			    uint32_t *cycles)
+{
+	uint32_t nr_recs = le16_to_cpu(blk->nr_records), size = le32_to_cpu(blk->size);
+	uint32_t len = nr_recs * ctx->rec_size;
+	const void *p = blk + 1;
+
+	*cycles = 0;
+	ctx->code_preds = 0;
+	if (nr_recs == 0 || nr_recs >= NVME_FILTER_BLOCK_ALIGN || len > NVME_FILTER_BLOCK_MAX_SIZE)
+		return NULL;
+
+	switch (blk->codec) {
+	case NVME_FILTER_CODEC_NONE:
+		return size >= len ? p : NULL;
+	case NVME_FILTER_CODEC_LZ4:
+		if (LZ4_decompress_safe(p, ctx->block, size, len) != (int)len)
+			return NULL;
+		*cycles = len * FILTER_CYCLES_PER_LZ4_BYTE;
+		return ctx->block;
+	case NVME_FILTER_CODEC_DICT:
+		if (__decode_dict(ctx, p, size, nr_recs, cycles))
+			return ctx->block;
+		ctx->code_preds = 0;
+		return NULL;
+	}
+
+	return NULL;
+}
+
+/*
+ * Filter the records of the blocks in [data, data + len), the first one at
+ * data. A trailing partial block is ignored. A stream resumes at record
+ * ctx->first_item of the first block.
+ */
+static size_t __blocks_scan(struct filter_ctx *ctx, const void *data, size_t len)
+{
+	uint32_t i, j, nr, offs[FILTER_BATCH];
+	uint32_t first = ctx->first_item;
+	size_t pos, next;
+
+	for (pos = 0; pos + sizeof(struct nvme_filter_block) <= len; pos = next, first = 0) {
+		const struct nvme_filter_block *blk = data + pos;
+		uint32_t nr_recs = le16_to_cpu(blk->nr_records);
+		struct filter_unit *unit;
+		const void *recs;
+		uint32_t cycles;
+		uint64_t sel;
+
+		next = ALIGN(pos + sizeof(*blk) + le32_to_cpu(blk->size), NVME_FILTER_BLOCK_ALIGN);
+		if (next > len)
+			break;
+
+		recs = __decode(ctx, blk, &cycles);
+		if (!recs)
+			continue;
+		unit = filter_unit_at(ctx, next - 1);
+		unit->cycles += cycles;
+
+		for (j = 0; j < FILTER_BATCH; j++)
+			offs[j] = next - 1;
+
+		for (i = first; i < nr_recs; i += nr) {
+			nr = min_t(uint32_t, FILTER_BATCH, nr_recs - i);
+
+			if (ctx->code_preds)
+				__eval_codes(ctx, i, nr);
+			sel = filter_eval_rows(ctx, recs + i * ctx->rec_size, nr);
+
+			/* the selection outputs do not look at the records */
+			if (blk->codec == NVME_FILTER_CODEC_DICT &&
+			    (ctx->output == NVME_FILTER_OUT_ROWS ||
+			     ctx->output == NVME_FILTER_OUT_STATS))
+				unit->cycles += __decode_codes(ctx, blk, i, sel);
+
+			if (!filter_emit_rows(ctx, recs + i * ctx->rec_size, nr, offs, sel))
+				return pos + i + ctx->stop_row;
+		}
+	}
+
+	return pos;
+}
+
+const struct filter_format filter_format_blocks = {
+	.name = "blocks",
+	.typed = false,
+	.cursor_align = NVME_FILTER_BLOCK_ALIGN,
+	.scan = __blocks_scan,
+};
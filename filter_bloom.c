@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <linux/jhash.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+
+#include "nvmev.h"
+#include "filter.h"
+
+/*
+ * Bloom filters loaded through the nvme_admin_filter_bloom admin command,
+ * id N in slot N. Filter commands hold a reference to the filters they
+ * test, so that a filter dropped meanwhile is freed once they are done.
+ * Together they take at most FILTER_BLOOM_MEM_SIZE of device memory.
+ */
+static struct filter_bloom *__blooms[NVME_FILTER_MAX_BLOOMS];
+static size_t __blooms_size;
+static DEFINE_SPINLOCK(__blooms_lock);
+
+static inline size_t __bloom_size(uint32_t nr_words)
+{
+	return sizeof(struct filter_bloom) + (size_t)nr_words * sizeof(uint64_t);
+}
+
+/* Load the filter the host buffer described by @prp1 and @prp2 holds */
+uint32_t filter_bloom_load(uint64_t prp1, uint64_t prp2, uint32_t *id)
+{
+	struct nvme_filter_bloom hdr;
+	struct filter_bloom *bloom;
+	struct filter_hbuf hb;
+	uint32_t i, nr_words;
+	size_t size;
+
+	filter_hbuf_init(&hb, prp1, prp2, sizeof(hdr));
+	filter_hbuf_read(&hb, &hdr, sizeof(hdr));
+
+	nr_words = le32_to_cpu(hdr.nr_words);
+	if (nr_words == 0 || hdr.nr_hashes == 0) {
+		NVMEV_ERROR("%s: empty filter (%u words, %u hashes)\n", __func__, nr_words,
+			    hdr.nr_hashes);
+		return NVME_SC_INVALID_FIELD;
+	}
+
+	size = __bloom_size(nr_words);
+	if (size > FILTER_BLOOM_MEM_SIZE) {
+		NVMEV_ERROR("%s: filter of %u words too large\n", __func__, nr_words);
+		return NVME_SC_CAP_EXCEEDED;
+	}
+
+	bloom = vmalloc(size);
+	if (!bloom)
+		return NVME_SC_INTERNAL;
+
+	kref_init(&bloom->ref);
+	bloom->size = size;
+	bloom->nr_bits = nr_words * 64;
+	bloom->nr_hashes = hdr.nr_hashes;
+	bloom->seed = le32_to_cpu(hdr.seed);
+
+	filter_hbuf_init(&hb, prp1, prp2, sizeof(hdr) + nr_words * sizeof(uint64_t));
+	filter_hbuf_read(&hb, &hdr, sizeof(hdr));
+	filter_hbuf_read(&hb, bloom->bits, nr_words * sizeof(uint64_t));
+
+	for (i = 0; i < nr_words; i++)
+		le64_to_cpus(&bloom->bits[i]);
+
+	spin_lock(&__blooms_lock);
+	for (i = 0; i < NVME_FILTER_MAX_BLOOMS; i++) {
+		if (__blooms[i] == NULL)
+			break;
+	}
+
+	if (i < NVME_FILTER_MAX_BLOOMS && __blooms_size + size <= FILTER_BLOOM_MEM_SIZE) {
+		__blooms[i] = bloom;
+		__blooms_size += size;
+		bloom = NULL;
+	}
+	spin_unlock(&__blooms_lock);
+
+	if (bloom) {
+		NVMEV_ERROR("%s: no room for a filter of %u words\n", __func__, nr_words);
+		vfree(bloom);
+		return NVME_SC_CAP_EXCEEDED;
+	}
+
+	NVMEV_INFO("filter: Bloom filter %u of %u bits, %u hashes\n", i, nr_words * 64,
+		   hdr.nr_hashes);
+	*id = i;
+
+	return NVME_SC_SUCCESS;
+}
+
+static void __bloom_release(struct kref *ref)
+{
+	vfree(container_of(ref, struct filter_bloom, ref));
+}
+
+uint32_t filter_bloom_drop(uint32_t id)
+{
+	struct filter_bloom *bloom = NULL;
+
+	spin_lock(&__blooms_lock);
+	if (id < NVME_FILTER_MAX_BLOOMS && __blooms[id] != NULL) {
+		bloom = __blooms[id];
+		__blooms[id] = NULL;
+		__blooms_size -= bloom->size;
+	}
+	spin_unlock(&__blooms_lock);
+
+	if (!bloom)
+		return NVME_SC_INVALID_FIELD;
+
+	filter_bloom_put(bloom);
+	return NVME_SC_SUCCESS;
+}
+
+/* A reference to filter @id, NULL if it is not loaded */
+struct filter_bloom *filter_bloom_get(uint32_t id)
+{
+	struct filter_bloom *bloom = NULL;
+
+	spin_lock(&__blooms_lock);
+	if (id < NVME_FILTER_MAX_BLOOMS && __blooms[id] != NULL) {
+		bloom = __blooms[id];
+		kref_get(&bloom->ref);
+	}
+	spin_unlock(&__blooms_lock);
+
+	return bloom;
+}
+
+void filter_bloom_put(struct filter_bloom *bloom)
+{
+	kref_put(&bloom->ref, __bloom_release);
+}
+
+void filter_blooms_exit(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < NVME_FILTER_MAX_BLOOMS; i++)
+		filter_bloom_drop(i);
+}
+
+/* The bits of a value are found by double hashing, as nvme_filter.h specifies */
+static bool __bloom_has(const struct filter_bloom *bloom, uint32_t v)
+{
+	uint32_t h1 = jhash_1word(v, bloom->seed);
+	uint32_t h2 = jhash_1word(v, h1) | 1;
+	uint32_t i, bit;
+
+	for (i = 0; i < bloom->nr_hashes; i++) {
+		bit = (h1 + i * h2) % bloom->nr_bits;
+		if (!(bloom->bits[bit / 64] & (1ULL << (bit % 64))))
+			return false;
+	}
+
+	return true;
+}
+
+/* Selection bitmap of the @nr records whose @column may be in @bloom */
+uint64_t filter_bloom_test(const struct filter_bloom *bloom, const void *recs, uint32_t nr,
+			   uint32_t rec_size, uint32_t column)
+{
+	uint64_t sel = 0;
+	uint32_t i;
+
+	for (i = 0; i < nr; i++) {
+		if (__bloom_has(bloom, filter_get_column(recs + i * rec_size, column)))
+			sel |= 1ULL << i;
+	}
+
+	return sel;
+}
@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <linux/spinlock.h>
+
+#include "nvmev.h"
+#include "filter.h"
+
+/*
+ * Tables registered through the nvme_admin_filter_table admin command, id N
+ * in slot N. A slot is free if its nsid is 0. The admin queue registers
+ * tables while filter commands look them up, hence the lock.
+ */
+static struct nvme_filter_table __tables[NVME_FILTER_MAX_TABLES];
+static DEFINE_SPINLOCK(__tables_lock);
+
+/* Register the table the host buffer described by @prp1 and @prp2 holds on namespace @nsid */
+uint32_t filter_table_register(uint32_t nsid, uint64_t prp1, uint64_t prp2, uint32_t *id)
+{
+	struct nvme_filter_table table;
+	struct filter_hbuf hb;
+	uint64_t slba, nlb;
+	uint32_t i;
+
+	if (nsid == 0 || nsid > nvmev_vdev->nr_ns) {
+		NVMEV_ERROR("%s: invalid namespace %u\n", __func__, nsid);
+		return NVME_SC_INVALID_NS;
+	}
+
+	filter_hbuf_init(&hb, prp1, prp2, sizeof(table));
+	filter_hbuf_read(&hb, &table, sizeof(table));
+	slba = le64_to_cpu(table.slba);
+	nlb = le64_to_cpu(table.nlb);
+
+	if (nlb == 0 || slba + nlb < slba ||
+	    LBA_TO_BYTE(slba + nlb) > nvmev_vdev->ns[nsid - 1].size) {
+		NVMEV_ERROR("%s: extent %llu+%llu out of namespace %u\n", __func__, slba, nlb,
+			    nsid);
+		return NVME_SC_LBA_RANGE;
+	}
+
+	if (!filter_format_valid(&table))
+		return NVME_SC_INVALID_FIELD;
+
+	if (!filter_formats[table.format]->typed && table.record_size == 0) {
+		NVMEV_ERROR("%s: record_size must be set for fixed-width records\n", __func__);
+		return NVME_SC_INVALID_FIELD;
+	}
+
+	spin_lock(&__tables_lock);
+	for (i = 0; i < NVME_FILTER_MAX_TABLES; i++) {
+		if (__tables[i].nsid == 0)
+			break;
+	}
+
+	if (i < NVME_FILTER_MAX_TABLES) {
+		table.nsid = cpu_to_le32(nsid);
+		table.id = cpu_to_le16(i);
+		__tables[i] = table;
+	}
+	spin_unlock(&__tables_lock);
+
+	if (i == NVME_FILTER_MAX_TABLES) {
+		NVMEV_ERROR("%s: no free table slot\n", __func__);
+		return NVME_SC_CAP_EXCEEDED;
+	}
+
+	NVMEV_INFO("filter: table %u on namespace %u, LBAs %llu+%llu\n", i, nsid, slba, nlb);
+	*id = i;
+
+	return NVME_SC_SUCCESS;
+}
+
+uint32_t filter_table_unregister(uint32_t id)
+{
+	uint32_t status = NVME_SC_INVALID_FIELD;
+
+	spin_lock(&__tables_lock);
+	if (id < NVME_FILTER_MAX_TABLES && __tables[id].nsid != 0) {
+		memset(&__tables[id], 0, sizeof(__tables[id]));
+		status = NVME_SC_SUCCESS;
+	}
+	spin_unlock(&__tables_lock);
+
+	return status;
+}
+
+/* Copy table @id to @table. Returns false if it is not registered. */
+bool filter_table_get(uint32_t id, struct nvme_filter_table *table)
+{
+	bool found = false;
+
+	spin_lock(&__tables_lock);
+	if (id < NVME_FILTER_MAX_TABLES && __tables[id].nsid != 0) {
+		*table = __tables[id];
+		found = true;
+	}
+	spin_unlock(&__tables_lock);
+
+	return found;
+}
+
+void filter_table_log(struct nvme_filter_table_log *log)
+{
+	uint32_t i, nr = 0;
+
+	memset(log, 0, sizeof(*log));
+
+	spin_lock(&__tables_lock);
+	for (i = 0; i < NVME_FILTER_MAX_TABLES; i++) {
+		if (__tables[i].nsid != 0)
+			log->tables[nr++] = __tables[i];
+	}
+	spin_unlock(&__tables_lock);
+
+	log->nr_tables = cpu_to_le16(nr);
+}
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include "nvmev.h"
+#include "filter.h"
+
+/*
+ * Fixed-width binary records, laid out back to back from the start of the
+ * scanned range. They are evaluated in place. A trailing partial record is
+ * ignored.
+ */
+static size_t __flat_scan(struct filter_ctx *ctx, const void *data, size_t len)
+{
+	uint32_t i, nr, rec_size = ctx->rec_size, offs[FILTER_BATCH];
+	size_t pos, end = (len / rec_size) * rec_size;
+
+	for (pos = 0; pos < end; pos += nr * rec_size) {
+		nr = min_t(size_t, FILTER_BATCH, (end - pos) / rec_size);
+		for (i = 0; i < nr; i++)
+			offs[i] = pos + i * rec_size;
+
+		if (!filter_scan_rows(ctx, data + pos, nr, offs))
+			return offs[ctx->stop_row];
+	}
+
+	return end;
+}
+
+const struct filter_format filter_format_flat = {
+	.name = "flat",
+	.typed = false,
+	.cursor_align = 1,
+	.scan = __flat_scan,
+};
+
+const struct filter_format *const filter_formats[NVME_FILTER_FMT_NR] = {
+	[NVME_FILTER_FMT_FLAT] = &filter_format_flat,
+	[NVME_FILTER_FMT_PG_HEAP] = &filter_format_pgheap,
+	[NVME_FILTER_FMT_TEXT] = &filter_format_text,
+	[NVME_FILTER_FMT_BLOCKS] = &filter_format_blocks,
+};
+
+/* Whether the formats can decode records laid out as @layout describes */
+bool filter_format_valid(const struct nvme_filter_table *layout)
+{
+	uint32_t i;
+
+	if (layout->format >= NVME_FILTER_FMT_NR) {
+		NVMEV_ERROR("%s: unknown format %u\n", __func__, layout->format);
+		return false;
+	}
+
+	if (!filter_formats[layout->format]->typed)
+		return true;
+
+	if (layout->nr_columns == 0 || layout->nr_columns > NVME_FILTER_MAX_COLUMNS) {
+		NVMEV_ERROR("%s: invalid number of columns %u\n", __func__, layout->nr_columns);
+		return false;
+	}
+
+	for (i = 0; i < layout->nr_columns; i++) {
+		if (layout->columns[i].type >= NVME_FILTER_TYPE_NR) {
+			NVMEV_ERROR("%s: column %u has unknown type %u\n", __func__, i,
+				    layout->columns[i].type);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Store the NULL bitmap of a row whose columns have all been put */
+void filter_row_finish(struct filter_ctx *ctx, uint32_t row, uint32_t nulls)
+{
+	uint32_t i;
+
+	filter_row_put(ctx, row, ctx->nr_columns, nulls);
+
+	for (i = 0; i < ctx->nr_columns; i++) {
+		if (nulls & (1U << i))
+			ctx->nulls[i] |= 1ULL << row;
+	}
+}
+
+/*
+ * Hand the @nr rows decoded so far to filter_scan_rows() and start a new
+ * batch. Returns false once the host buffer is full.
+ */
+bool filter_rows_flush(struct filter_ctx *ctx, uint32_t *nr, const uint32_t *offs)
+{
+	bool more = true;
+
+	if (*nr)
+		more = filter_scan_rows(ctx, ctx->rows, *nr, offs);
+
+	*nr = 0;
+	memset(ctx->nulls, 0, sizeof(ctx->nulls));
+	memset(ctx->row_cycles, 0, sizeof(ctx->row_cycles));
+
+	return more;
+}
+
+/* the first four bytes, big-endian so that the order of prefixes is kept */
+int32_t filter_text_prefix(const uint8_t *s, uint32_t len, bool bpchar)
+{
+	uint32_t i, v = 0;
+
+	while (bpchar && len && s[len - 1] == ' ')
+		len--;
+
+	for (i = 0; i < sizeof(v); i++)
+		v = (v << 8) | (i < len ? s[i] : 0);
+
+	return (int32_t)v;
+}
@@ -0,0 +1,179 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include "nvmev.h"
+#include "filter.h"
+
+/*
+ * SQL LIKE patterns. A pattern is split at its '%' into segments, which
+ * must be found in the value in order, without overlapping. The first one
+ * must start the value unless the pattern starts with '%', the last one
+ * must end it unless the pattern ends with '%'. Segments without '_' are
+ * searched for with the substring search kernel.
+ */
+bool filter_like_compile(struct filter_like *like, uint32_t column, const char *pattern,
+			 uint32_t len)
+{
+	uint32_t i, start = 0;
+
+	if (len > NVME_FILTER_MAX_PATTERN_LEN) {
+		NVMEV_ERROR("%s: pattern of %u bytes too long\n", __func__, len);
+		return false;
+	}
+
+	*like = (struct filter_like){
+		.column = column,
+		.anchor_start = len == 0 || pattern[0] != '%',
+		.anchor_end = len == 0 || pattern[len - 1] != '%',
+		.nr_segs = 0,
+	};
+	memcpy(like->pattern, pattern, len);
+
+	for (i = 0; i <= len; i++) {
+		struct filter_like_seg *seg;
+
+		if (i < len && pattern[i] != '%')
+			continue;
+
+		/* '%%' is a single '%' */
+		if (i > start) {
+			if (like->nr_segs == FILTER_LIKE_MAX_SEGS) {
+				NVMEV_ERROR("%s: too many segments in pattern\n", __func__);
+				return false;
+			}
+
+			seg = &like->segs[like->nr_segs++];
+			*seg = (struct filter_like_seg){
+				.offs = start,
+				.len = i - start,
+				.any = memchr(pattern + start, '_', i - start) != NULL,
+			};
+		}
+		start = i + 1;
+	}
+
+	return true;
+}
+
+static bool __seg_eq(const struct filter_like *like, const struct filter_like_seg *seg,
+		     const uint8_t *s)
+{
+	const char *p = like->pattern + seg->offs;
+	uint32_t i;
+
+	if (!seg->any)
+		return memcmp(s, p, seg->len) == 0;
+
+	for (i = 0; i < seg->len; i++) {
+		if (p[i] != '_' && p[i] != s[i])
+			return false;
+	}
+
+	return true;
+}
+
+/* offset of the first occurrence of @seg in @s, -1 if there is none */
+static int32_t __seg_find(const struct filter_kernels *k, const struct filter_like *like,
+			  const struct filter_like_seg *seg, const uint8_t *s, uint32_t len)
+{
+	uint32_t i;
+
+	if (!seg->any)
+		return k->find((const char *)s, len, like->pattern + seg->offs, seg->len);
+
+	for (i = 0; i + seg->len <= len; i++) {
+		if (__seg_eq(like, seg, s + i))
+			return i;
+	}
+
+	return -1;
+}
+
+static bool __match(const struct filter_kernels *k, const struct filter_like *like,
+		    const uint8_t *s, uint32_t len)
+{
+	const struct filter_like_seg *first, *last;
+	uint32_t i = 0, start = 0, end = len;
+	int32_t found;
+
+	if (like->nr_segs == 0)
+		return !like->anchor_start || len == 0;
+
+	first = &like->segs[0];
+	last = &like->segs[like->nr_segs - 1];
+
+	if (like->anchor_start) {
+		if (first->len > len || !__seg_eq(like, first, s))
+			return false;
+		start = first->len;
+		i++;
+	}
+
+	if (like->anchor_end && i < like->nr_segs) {
+		if (last->len > end - start || !__seg_eq(like, last, s + len - last->len))
+			return false;
+		end = len - last->len;
+	} else if (like->anchor_end && len != start) {
+		/* a pattern without '%' is the first and last segment at once */
+		return false;
+	}
+
+	for (; i < like->nr_segs - like->anchor_end; i++) {
+		const struct filter_like_seg *seg = &like->segs[i];
+
+		found = __seg_find(k, like, seg, s + start, end - start);
+		if (found < 0)
+			return false;
+		start += found + seg->len;
+	}
+
+	return true;
+}
+
+/*
+ * Record the value @s of @column in row @row of the batch being decoded
+ * for the LIKE clauses on it, which are matched once the batch is.
+ */
+void filter_like_row(struct filter_ctx *ctx, uint32_t row, uint32_t column, const uint8_t *s,
+		     uint32_t len)
+{
+	uint32_t i;
+
+	if (!(ctx->like_cols & (1U << column)))
+		return;
+
+	while (ctx->columns[column].type == NVME_FILTER_TYPE_BPCHAR && len && s[len - 1] == ' ')
+		len--;
+
+	for (i = 0; i < ctx->nr_likes; i++) {
+		if (ctx->likes[i].column == column)
+			ctx->like_vals[i][row] = (struct filter_like_val){ .s = s, .len = len };
+	}
+}
+
+/*
+ * Match the values of the @nr rows of the batch against the LIKE clauses,
+ * within the FPU section of filter_eval_rows(). NULL values, whose rows
+ * hold no value, match none.
+ */
+void filter_like_batch(struct filter_ctx *ctx, uint32_t nr)
+{
+	const struct filter_kernels *k = filter_kernels;
+	uint32_t i, row;
+
+	for (i = 0; i < ctx->nr_likes; i++) {
+		const struct filter_like *like = &ctx->likes[i];
+		uint64_t nulls = ctx->nulls[like->column], sel = 0;
+
+		for (row = 0; row < nr; row++) {
+			const struct filter_like_val *val = &ctx->like_vals[i][row];
+
+			if (nulls & (1ULL << row))
+				continue;
+
+			if (__match(k, like, val->s, val->len))
+				sel |= 1ULL << row;
+			ctx->row_cycles[row] += val->len * FILTER_CYCLES_PER_LIKE_BYTE;
+		}
+		ctx->like_sel[i] = sel;
+	}
+}
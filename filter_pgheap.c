@@ -0,0 +1,320 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <asm/unaligned.h>
+
+#include "nvmev.h"
+#include "filter.h"
+
+/*
+ * Decoder of PostgreSQL heap pages (src/include/storage/bufpage.h,
+ * src/include/access/htup_details.h). Only the little-endian layout of the
+ * default 8 KiB block size is understood.
+ */
+#define PG_BLCKSZ (8192)
+#define PG_PAGE_HEADER_SIZE (24) /* SizeOfPageHeaderData */
+#define PG_ITEM_ID_SIZE (4)
+
+/* PageHeaderData */
+#define PD_LOWER (12)
+#define PD_UPPER (14)
+#define PD_SPECIAL (16)
+#define PD_PAGESIZE_VERSION (18)
+
+/* ItemIdData: lp_off:15, lp_flags:2, lp_len:15 */
+#define LP_OFF(lp) ((lp)&0x7fff)
+#define LP_FLAGS(lp) (((lp) >> 15) & 0x3)
+#define LP_LEN(lp) ((lp) >> 17)
+#define LP_NORMAL (1)
+
+/* HeapTupleHeaderData */
+#define T_INFOMASK2 (18)
+#define T_INFOMASK (20)
+#define T_HOFF (22)
+#define T_BITS (23)
+
+#define HEAP_NATTS_MASK (0x07ff)
+#define HEAP_HASNULL (0x0001)
+#define HEAP_XMAX_LOCK_ONLY (0x0080)
+#define HEAP_XMIN_INVALID (0x0200)
+#define HEAP_XMIN_FROZEN (0x0300)
+#define HEAP_XMAX_COMMITTED (0x0400)
+
+/* varlena headers, varatt.h */
+#define VARTAG_ONDISK (18)
+#define VARATT_EXTERNAL_SIZE (2 + 16)
+
+/* NumericData, utils/adt/numeric.c */
+#define NUMERIC_SIGN_MASK (0xc000)
+#define NUMERIC_NEG (0x4000)
+#define NUMERIC_SHORT (0x8000)
+#define NUMERIC_SPECIAL (0xc000)
+#define NUMERIC_SHORT_SIGN_MASK (0x2000)
+#define NUMERIC_SHORT_WEIGHT_SIGN_MASK (0x0040)
+#define NUMERIC_SHORT_WEIGHT_MASK (0x003f)
+#define NUMERIC_DEC_DIGITS (4) /* per base 10000 digit */
+
+static const int64_t __pow10[] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+/* Returns the number of line pointers of a heap page, 0 if it is new or not one */
+static uint32_t __page_items(const void *page)
+{
+	uint32_t lower = get_unaligned_le16(page + PD_LOWER);
+	uint32_t upper = get_unaligned_le16(page + PD_UPPER);
+	uint32_t special = get_unaligned_le16(page + PD_SPECIAL);
+	uint32_t version = get_unaligned_le16(page + PD_PAGESIZE_VERSION);
+
+	if (upper == 0 || (version & 0xff00) != PG_BLCKSZ)
+		return 0;
+
+	if (lower < PG_PAGE_HEADER_SIZE || lower > upper || upper > special ||
+	    special > PG_BLCKSZ)
+		return 0;
+
+	return (lower - PG_PAGE_HEADER_SIZE) / PG_ITEM_ID_SIZE;
+}
+
+/* tuples whose inserter aborted or whose deleter committed, as far as the hint bits tell */
+static bool __tuple_dead(uint16_t infomask)
+{
+	if ((infomask & HEAP_XMIN_FROZEN) == HEAP_XMIN_INVALID)
+		return true;
+
+	return (infomask & HEAP_XMAX_COMMITTED) && !(infomask & HEAP_XMAX_LOCK_ONLY);
+}
+
+static int32_t __clamp_s32(int64_t v)
+{
+	return clamp_t(int64_t, v, S32_MIN, S32_MAX);
+}
+
+/* the value of a NUMERIC scaled by 10^scale, truncated toward zero */
+static int __numeric(const void *p, uint32_t size, uint32_t scale, int32_t *v)
+{
+	uint16_t head;
+	uint32_t i, nr_digits;
+	int32_t weight, e;
+	int64_t acc = 0;
+	bool neg;
+
+	if (size < sizeof(head))
+		return -EINVAL;
+	head = get_unaligned_le16(p);
+
+	if ((head & NUMERIC_SIGN_MASK) == NUMERIC_SHORT) {
+		neg = head & NUMERIC_SHORT_SIGN_MASK;
+		weight = head & NUMERIC_SHORT_WEIGHT_MASK;
+		if (head & NUMERIC_SHORT_WEIGHT_SIGN_MASK)
+			weight |= ~NUMERIC_SHORT_WEIGHT_MASK;
+		p += 2;
+		size -= 2;
+	} else if ((head & NUMERIC_SIGN_MASK) == NUMERIC_SPECIAL) {
+		/* NaN and the infinities */
+		return -EOPNOTSUPP;
+	} else {
+		if (size < 4)
+			return -EINVAL;
+		neg = (head & NUMERIC_SIGN_MASK) == NUMERIC_NEG;
+		weight = (int16_t)get_unaligned_le16(p + 2);
+		p += 4;
+		size -= 4;
+	}
+
+	/* digit i is worth 10000^(weight - i), most significant first */
+	nr_digits = size / sizeof(uint16_t);
+	for (i = 0; i < nr_digits && acc <= S32_MAX; i++) {
+		uint32_t d = get_unaligned_le16(p + i * sizeof(uint16_t));
+
+		e = NUMERIC_DEC_DIGITS * (weight - (int32_t)i) + scale;
+		if (e >= (int32_t)ARRAY_SIZE(__pow10))
+			acc = d ? (int64_t)S32_MAX + 1 : acc;
+		else if (e >= 0)
+			acc += d * __pow10[e];
+		else if (e > -NUMERIC_DEC_DIGITS)
+			acc += d / __pow10[-e];
+		else
+			break;
+	}
+
+	*v = __clamp_s32(neg ? -acc : acc);
+	return 0;
+}
+
+/*
+ * Decode the variable length attribute at @off of a tuple of @len bytes,
+ * column @column of row @row, and advance @off past it. Returns -EOPNOTSUPP
+ * for values that are not stored inline and uncompressed.
+ */
+static int __varlena(struct filter_ctx *ctx, uint32_t row, uint32_t column, const void *tup,
+		     uint32_t len, uint32_t *off, int32_t *v)
+{
+	const struct filter_column *col = &ctx->columns[column];
+	const uint8_t *p;
+	uint32_t hdr, size;
+
+	if (*off >= len)
+		return -EINVAL;
+
+	/* values with a 1 byte header are not aligned, the padding is zeroed */
+	if (*(const uint8_t *)(tup + *off) == 0)
+		*off = ALIGN(*off, sizeof(uint32_t));
+	if (*off >= len)
+		return -EINVAL;
+	p = tup + *off;
+
+	if (p[0] == 0x01) {
+		/* TOAST pointer */
+		if (*off + 2 > len || p[1] != VARTAG_ONDISK || *off + VARATT_EXTERNAL_SIZE > len)
+			return -EINVAL;
+		*off += VARATT_EXTERNAL_SIZE;
+		return -EOPNOTSUPP;
+	}
+
+	if (p[0] & 0x01) {
+		hdr = 1;
+		size = p[0] >> 1;
+	} else {
+		if (*off + 4 > len)
+			return -EINVAL;
+		hdr = 4;
+		size = get_unaligned_le32(p) >> 2;
+	}
+
+	if (size < hdr || *off + size > len)
+		return -EINVAL;
+	*off += size;
+
+	/* compressed inline */
+	if (hdr == 4 && (p[0] & 0x03) == 0x02)
+		return -EOPNOTSUPP;
+
+	if (col->type == NVME_FILTER_TYPE_NUMERIC)
+		return __numeric(p + hdr, size - hdr, col->scale, v);
+
+	filter_like_row(ctx, row, column, p + hdr, size - hdr);
+	*v = filter_text_prefix(p + hdr, size - hdr, col->type == NVME_FILTER_TYPE_BPCHAR);
+	return 0;
+}
+
+static int __attr(struct filter_ctx *ctx, uint32_t row, uint32_t column, const void *tup,
+		  uint32_t len, uint32_t *off, int32_t *v)
+{
+	switch (ctx->columns[column].type) {
+	case NVME_FILTER_TYPE_INT4:
+	case NVME_FILTER_TYPE_DATE:
+		*off = ALIGN(*off, sizeof(int32_t));
+		if (*off + sizeof(int32_t) > len)
+			return -EINVAL;
+		*v = (int32_t)get_unaligned_le32(tup + *off);
+		*off += sizeof(int32_t);
+		return 0;
+	case NVME_FILTER_TYPE_INT8:
+		*off = ALIGN(*off, sizeof(int64_t));
+		if (*off + sizeof(int64_t) > len)
+			return -EINVAL;
+		*v = __clamp_s32((int64_t)get_unaligned_le64(tup + *off));
+		*off += sizeof(int64_t);
+		return 0;
+	}
+
+	return __varlena(ctx, row, column, tup, len, off, v);
+}
+
+/*
+ * Decode the first nr_columns attributes of the tuple into row @row of
+ * ctx->rows. Returns false if the tuple is dead or malformed.
+ */
+static bool __deform(struct filter_ctx *ctx, const void *tup, uint32_t len, uint32_t row)
+{
+	uint16_t infomask = get_unaligned_le16(tup + T_INFOMASK);
+	uint32_t natts = get_unaligned_le16(tup + T_INFOMASK2) & HEAP_NATTS_MASK;
+	uint32_t off = *(const uint8_t *)(tup + T_HOFF);
+	const uint8_t *bits = NULL;
+	uint32_t i, nulls = 0;
+
+	if (__tuple_dead(infomask) || off > len)
+		return false;
+
+	if (infomask & HEAP_HASNULL) {
+		if (T_BITS + DIV_ROUND_UP(natts, 8) > off)
+			return false;
+		bits = tup + T_BITS;
+	}
+
+	for (i = 0; i < ctx->nr_columns; i++) {
+		int32_t v = 0;
+		int ret;
+
+		/* attributes added after the tuple was written are NULL too */
+		if (i >= natts || (bits && !(bits[i / 8] & (1 << (i % 8))))) {
+			nulls |= 1U << i;
+		} else {
+			ret = __attr(ctx, row, i, tup, len, &off, &v);
+			if (ret == -EINVAL)
+				return false;
+			if (ret) {
+				nulls |= 1U << i;
+				v = 0;
+			}
+		}
+
+		filter_row_put(ctx, row, i, v);
+	}
+	filter_row_finish(ctx, row, nulls);
+
+	return true;
+}
+
+/*
+ * Filter the live tuples of the heap pages in [data, data + len), which
+ * starts at the beginning of a page. A trailing partial page is ignored.
+ * Decoding a tuple is accounted to the unit it is stored in. A stream
+ * resumes at line pointer ctx->first_item of the first page.
+ */
+static size_t __pgheap_scan(struct filter_ctx *ctx, const void *data, size_t len)
+{
+	uint32_t offs[FILTER_BATCH], items[FILTER_BATCH], nr = 0;
+	uint32_t first = ctx->first_item;
+	size_t pos;
+
+	memset(ctx->nulls, 0, sizeof(ctx->nulls));
+
+	for (pos = 0; pos + PG_BLCKSZ <= len; pos += PG_BLCKSZ, first = 0) {
+		const void *page = data + pos;
+		uint32_t item, nr_items = __page_items(page);
+
+		for (item = first; item < nr_items; item++) {
+			uint32_t lp = get_unaligned_le32(page + PG_PAGE_HEADER_SIZE +
+							 item * PG_ITEM_ID_SIZE);
+
+			if (LP_FLAGS(lp) != LP_NORMAL || LP_LEN(lp) <= T_BITS ||
+			    LP_OFF(lp) + LP_LEN(lp) > PG_BLCKSZ)
+				continue;
+
+			filter_unit_at(ctx, pos + LP_OFF(lp))->cycles +=
+				LP_LEN(lp) * FILTER_CYCLES_PER_BYTE;
+
+			if (!__deform(ctx, page + LP_OFF(lp), LP_LEN(lp), nr))
+				continue;
+
+			items[nr] = item;
+			offs[nr++] = pos + LP_OFF(lp);
+			if (nr == FILTER_BATCH && !filter_rows_flush(ctx, &nr, offs))
+				goto stop;
+		}
+	}
+
+	if (filter_rows_flush(ctx, &nr, offs))
+		return pos;
+
+stop:
+	return rounddown(offs[ctx->stop_row], PG_BLCKSZ) + items[ctx->stop_row];
+}
+
+const struct filter_format filter_format_pgheap = {
+	.name = "pg_heap",
+	.typed = true,
+	.cursor_align = PG_BLCKSZ,
+	.scan = __pgheap_scan,
+};
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <linux/vmalloc.h>
+
+#include "nvmev.h"
+#include "filter.h"
+
+/*
+ * Cooperative scans. The last FILTER_SHARED_SCANS filter commands of a
+ * namespace leave behind when they sensed each page they read. A command
+ * arriving while one of them is still sensing the pages it needs attaches
+ * to it: the pages sensed from the time it starts on are evaluated against
+ * its program as they come, and only those sensed before are read again,
+ * as a late arrival wraps around to what it missed.
+ */
+bool filter_shared_init(struct filter_shared *shared, uint32_t max_pgs)
+{
+	uint32_t i;
+
+	memset(shared, 0, sizeof(*shared));
+
+	for (i = 0; i <= FILTER_SHARED_SCANS; i++) {
+		uint64_t *nsecs = vmalloc(max_pgs * sizeof(uint64_t));
+
+		if (!nsecs) {
+			NVMEV_ERROR("%s: failed to allocate shared scans\n", __func__);
+			filter_shared_exit(shared);
+			return false;
+		}
+
+		if (i < FILTER_SHARED_SCANS)
+			shared->scans[i].nsecs_sensed = nsecs;
+		else
+			shared->pending = nsecs;
+	}
+	shared->max_pgs = max_pgs;
+
+	return true;
+}
+
+void filter_shared_exit(struct filter_shared *shared)
+{
+	uint32_t i;
+
+	for (i = 0; i < FILTER_SHARED_SCANS; i++) {
+		vfree(shared->scans[i].nsecs_sensed);
+		shared->scans[i].nsecs_sensed = NULL;
+		shared->scans[i].nr_pgs = 0;
+	}
+
+	vfree(shared->pending);
+	shared->pending = NULL;
+	shared->max_pgs = 0;
+}
+
+/*
+ * Start recording when the @nr_pgs pages of a scan are sensed, in the array
+ * returned, 0 for those that are not. Returns NULL if the scan is too large
+ * to be shared.
+ */
+uint64_t *filter_shared_begin(struct filter_shared *shared, uint32_t nr_pgs)
+{
+	if (nr_pgs > shared->max_pgs)
+		return NULL;
+
+	memset(shared->pending, 0, nr_pgs * sizeof(uint64_t));
+	return shared->pending;
+}
+
+/*
+ * Make the scan of the @nr_pgs pages from @start_lpn recorded since
+ * filter_shared_begin() available to later commands, in place of the one
+ * that finished sensing first.
+ */
+void filter_shared_end(struct filter_shared *shared, uint64_t start_lpn, uint32_t nr_pgs)
+{
+	struct filter_shared_scan *scan = &shared->scans[0];
+	uint64_t *nsecs = shared->pending;
+	uint32_t i;
+
+	for (i = 1; i < FILTER_SHARED_SCANS; i++) {
+		if (shared->scans[i].nsecs_end < scan->nsecs_end)
+			scan = &shared->scans[i];
+	}
+
+	shared->pending = scan->nsecs_sensed;
+	scan->nsecs_sensed = nsecs;
+	scan->start_lpn = start_lpn;
+	scan->nr_pgs = nr_pgs;
+	scan->nsecs_end = 0;
+
+	for (i = 0; i < nr_pgs; i++)
+		scan->nsecs_end = max(scan->nsecs_end, nsecs[i]);
+}
+
+/*
+ * When a scan in progress senses @lpn at @nsecs or later, for a command
+ * starting then to attach to it. Returns 0 if none does.
+ */
+uint64_t filter_shared_sensed(struct filter_shared *shared, uint64_t lpn, uint64_t nsecs)
+{
+	uint64_t sensed = 0;
+	uint32_t i;
+
+	for (i = 0; i < FILTER_SHARED_SCANS; i++) {
+		struct filter_shared_scan *scan = &shared->scans[i];
+		uint64_t t;
+
+		if (scan->nsecs_end < nsecs || lpn < scan->start_lpn ||
+		    lpn - scan->start_lpn >= scan->nr_pgs)
+			continue;
+
+		t = scan->nsecs_sensed[lpn - scan->start_lpn];
+		if (t >= nsecs && (sensed == 0 || t < sensed))
+			sensed = t;
+	}
+
+	return sensed;
+}
+
+/* Pages [@start_lpn, @end_lpn] are written, scans that read them are not shared anymore */
+void filter_shared_drop(struct filter_shared *shared, uint64_t start_lpn, uint64_t end_lpn)
+{
+	uint32_t i;
+
+	for (i = 0; i < FILTER_SHARED_SCANS; i++) {
+		struct filter_shared_scan *scan = &shared->scans[i];
+
+		if (scan->nr_pgs && start_lpn < scan->start_lpn + scan->nr_pgs &&
+		    end_lpn >= scan->start_lpn) {
+			scan->nr_pgs = 0;
+			scan->nsecs_end = 0;
+		}
+	}
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <asm/cpufeature.h>
+
+#include "nvmev.h"
+#include "filter.h"
+
+/*
+ * Predicate kernels. Each evaluates one clause on up to FILTER_BATCH records
+ * laid out @rec_size bytes apart and returns the selection bitmap, bit i set
+ * if record i satisfies it. The vectorized ones, in filter_avx2.c, gather the
+ * column of several records at once and compare them in a single
+ * instruction, two for BETWEEN. Only that file is built with the FPU
+ * enabled, as the others run outside kernel_fpu_begin().
+ */
+
+uint64_t filter_cmp_i32_scalar(const void *recs, uint32_t nr, uint32_t rec_size,
+			       const struct filter_pred *pred)
+{
+	uint64_t sel = 0;
+	uint32_t i;
+
+	for (i = 0; i < nr; i++, recs += rec_size) {
+		if (filter_cmp(filter_get_column(recs, pred->column), pred))
+			sel |= 1ULL << i;
+	}
+
+	return sel;
+}
+
+/* Code range kernels, for clauses on dictionary-encoded columns */
+uint64_t filter_range_u8_scalar(const uint8_t *codes, uint32_t nr, uint8_t lo, uint8_t hi)
+{
+	uint64_t sel = 0;
+	uint32_t i;
+
+	for (i = 0; i < nr; i++) {
+		if (codes[i] >= lo && codes[i] <= hi)
+			sel |= 1ULL << i;
+	}
+
+	return sel;
+}
+
+/*
+ * Substring search kernels. The vectorized one compares the first and the
+ * last byte of the needle at 32 positions of the string at once, and
+ * compares the rest only where both match.
+ */
+int32_t filter_find_scalar(const char *s, uint32_t len, const char *needle, uint32_t nlen)
+{
+	uint32_t i;
+
+	for (i = 0; i + nlen <= len; i++) {
+		if (memcmp(s + i, needle, nlen) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+static const struct filter_kernels __kernels_scalar = {
+	.name = "scalar",
+	.fpu = false,
+	.cmp_i32 = filter_cmp_i32_scalar,
+	.range_u8 = filter_range_u8_scalar,
+	.find = filter_find_scalar,
+};
+
+const struct filter_kernels *filter_kernels = &__kernels_scalar;
+
+/* Pick the widest kernels the CPU supports. Called while loading the module. */
+void filter_select_kernels(void)
+{
+	filter_kernels = &__kernels_scalar;
+
+	if (boot_cpu_has(X86_FEATURE_AVX2) && boot_cpu_has(X86_FEATURE_AVX))
+		filter_kernels = &filter_kernels_avx2;
+
+	NVMEV_INFO("filter: using %s predicate kernels\n", filter_kernels->name);
+}
@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/sort.h>
+
+#include "nvmev.h"
+#include "filter.h"
+
+/*
+ * Column statistics for the optimizer. The histogram is built once the scan
+ * is done from a uniform sample of the values, kept by reservoir sampling
+ * (Vitter's algorithm R), and the distinct values are counted with a
+ * HyperLogLog sketch (Flajolet et al., 2007), so that the memory used does
+ * not depend on the number of records.
+ */
+#define HLL_ALPHA_FP (47271) /* 0.7213 in 16.16 fixed point */
+#define LN2_FP (45426) /* ln(2) in 16.16 fixed point */
+
+bool filter_stats_init(struct filter_stats *stats, struct filter_arena *arena, uint32_t nr_cols,
+		       const uint16_t *cols, uint32_t nr_buckets)
+{
+	uint32_t i;
+
+	*stats = (struct filter_stats){
+		.nr_cols = nr_cols,
+		.nr_buckets = nr_buckets,
+		.entry_size = sizeof(struct nvme_filter_stats),
+	};
+	if (nr_buckets)
+		stats->entry_size += ALIGN((nr_buckets + 1) * sizeof(__le32), sizeof(__le64));
+
+	stats->cols = filter_arena_alloc(arena, nr_cols * sizeof(stats->cols[0]));
+	if (!stats->cols)
+		return false;
+
+	for (i = 0; i < nr_cols; i++) {
+		struct filter_col_stats *cs = &stats->cols[i];
+
+		*cs = (struct filter_col_stats){
+			.column = cols[i],
+			.min = S32_MAX,
+			.max = S32_MIN,
+		};
+
+		cs->sample = filter_arena_alloc(arena, FILTER_STATS_SAMPLE_SIZE * sizeof(int32_t));
+		cs->regs = filter_arena_alloc(arena, NVME_FILTER_HLL_REGS);
+		if (!cs->sample || !cs->regs)
+			return false;
+
+		memset(cs->regs, 0, NVME_FILTER_HLL_REGS);
+	}
+
+	return true;
+}
+
+/* Fold a record whose NULL columns are set in @nulls into the statistics */
+void filter_stats_fold(struct filter_stats *stats, const void *rec, uint32_t nulls)
+{
+	uint32_t i, h, reg, rank;
+	uint64_t n, j;
+	int32_t v;
+
+	for (i = 0; i < stats->nr_cols; i++) {
+		struct filter_col_stats *cs = &stats->cols[i];
+
+		if (cs->column < 32 && (nulls & (1U << cs->column))) {
+			cs->nr_nulls++;
+			continue;
+		}
+
+		v = filter_get_column(rec, cs->column);
+		cs->min = min(cs->min, v);
+		cs->max = max(cs->max, v);
+
+		/* the register of the top bits keeps the most leading zeros of the others, + 1 */
+		h = jhash_1word(v, 0);
+		reg = h >> (32 - NVME_FILTER_HLL_BITS);
+		h = (h << NVME_FILTER_HLL_BITS) | (1U << (NVME_FILTER_HLL_BITS - 1));
+		rank = __builtin_clz(h) + 1;
+		cs->regs[reg] = max_t(uint8_t, cs->regs[reg], rank);
+
+		/* value n replaces one of the sample, picked in [0, n], if it is in it */
+		n = cs->nr_values++;
+		if (n < FILTER_STATS_SAMPLE_SIZE) {
+			cs->sample[n] = v;
+			continue;
+		}
+
+		j = mul_u64_u32_shr(n + 1, jhash_2words(lower_32_bits(n), upper_32_bits(n),
+							 cs->column), 32);
+		if (j < FILTER_STATS_SAMPLE_SIZE)
+			cs->sample[j] = v;
+	}
+}
+
+/* log2(@x) in 16.16 fixed point, @x > 0 */
+static uint64_t __log2_fp(uint64_t x)
+{
+	uint32_t i, l = ilog2(x);
+	uint64_t r = (uint64_t)l << 16;
+	/* in [1, 2) with 31 fractional bits */
+	uint64_t y = l > 31 ? x >> (l - 31) : x << (31 - l);
+
+	for (i = 0; i < 16; i++) {
+		y = (y * y) >> 31;
+		if (y >= (1ULL << 32)) {
+			y >>= 1;
+			r |= 1ULL << (15 - i);
+		}
+	}
+
+	return r;
+}
+
+/* The number of distinct values estimated from the registers, with the usual corrections */
+uint64_t filter_stats_distinct(const struct filter_col_stats *cs)
+{
+	const uint64_t m = NVME_FILTER_HLL_REGS;
+	uint64_t alpha = HLL_ALPHA_FP * m * 1000 / (m * 1000 + 1079);
+	uint64_t sum = 0, zeros = 0, e;
+	uint32_t i;
+
+	/* alpha * m^2 / sum of 2^-reg, the sum in 32.32 fixed point */
+	for (i = 0; i < m; i++) {
+		sum += 1ULL << (32 - cs->regs[i]);
+		zeros += cs->regs[i] == 0;
+	}
+	e = ((alpha * m * m) << 16) / sum;
+
+	/* linear counting while registers are empty: m * ln(m / zeros) */
+	if (e <= 5 * m / 2 && zeros)
+		return (m * (__log2_fp(m) - __log2_fp(zeros)) * LN2_FP) >> 32;
+
+	/* 32-bit hashes collide: -2^32 * ln(1 - e / 2^32) */
+	if (e > (1ULL << 32) / 30) {
+		e = min_t(uint64_t, e, U32_MAX);
+		return ((32ULL << 16) - __log2_fp((1ULL << 32) - e)) * LN2_FP;
+	}
+
+	return e;
+}
+
+static int __cmp_i32(const void *a, const void *b)
+{
+	int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Sort the sample of @cs and put the bounds of the equi-depth histogram of
+ * @nr_buckets buckets in @bounds, the minimum and maximum at either end.
+ * Returns their number, fewer than @nr_buckets + 1 if there are fewer
+ * values, and adds the cycles it took to @cycles.
+ */
+uint32_t filter_stats_bounds(struct filter_col_stats *cs, uint32_t nr_buckets, __le32 *bounds,
+			     uint64_t *cycles)
+{
+	uint32_t i, nr, n = min_t(uint64_t, cs->nr_values, FILTER_STATS_SAMPLE_SIZE);
+
+	if (nr_buckets == 0 || n == 0)
+		return 0;
+
+	sort(cs->sample, n, sizeof(cs->sample[0]), __cmp_i32, NULL);
+	*cycles += (uint64_t)n * (ilog2(n) + 1) * FILTER_CYCLES_PER_COMPARE;
+
+	nr = min(nr_buckets + 1, n);
+	for (i = 1; i + 1 < nr; i++)
+		bounds[i] = cpu_to_le32(cs->sample[(uint64_t)i * (n - 1) / (nr - 1)]);
+	bounds[0] = cpu_to_le32(cs->min);
+	bounds[nr - 1] = cpu_to_le32(cs->max);
+
+	return nr;
+}
@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <linux/ctype.h>
+#include <linux/rtc.h>
+#include <linux/time.h>
+
+#include "nvmev.h"
+#include "filter.h"
+
+/*
+ * The decimal number in @s scaled by 10^scale and truncated toward zero.
+ * Returns -EINVAL if it is not one.
+ */
+static int __parse_decimal(const char *s, uint32_t len, uint32_t scale, int32_t *v)
+{
+	uint32_t i = 0, frac = 0;
+	bool neg = false, dot = false, digits = false;
+	int64_t acc = 0;
+
+	if (len && (s[0] == '-' || s[0] == '+'))
+		neg = s[i++] == '-';
+
+	for (; i < len; i++) {
+		if (s[i] == '.' && !dot) {
+			dot = true;
+			continue;
+		}
+		if (!isdigit(s[i]))
+			return -EINVAL;
+
+		digits = true;
+		if (dot && frac == scale)
+			continue;
+
+		/* saturate, the result is clamped anyway */
+		if (acc <= S32_MAX)
+			acc = acc * 10 + (s[i] - '0');
+		frac += dot;
+	}
+
+	if (!digits)
+		return -EINVAL;
+
+	for (; frac < scale && acc <= S32_MAX; frac++)
+		acc *= 10;
+
+	*v = clamp_t(int64_t, neg ? -acc : acc, S32_MIN, S32_MAX);
+	return 0;
+}
+
+/* YYYY-MM-DD as days since 2000-01-01, as PostgreSQL stores dates */
+static int __parse_date(const char *s, uint32_t len, int32_t *v)
+{
+	uint32_t i, y, m, d;
+
+	if (len != 10 || s[4] != '-' || s[7] != '-')
+		return -EINVAL;
+
+	for (i = 0; i < len; i++) {
+		if (i != 4 && i != 7 && !isdigit(s[i]))
+			return -EINVAL;
+	}
+
+	y = (s[0] - '0') * 1000 + (s[1] - '0') * 100 + (s[2] - '0') * 10 + (s[3] - '0');
+	m = (s[5] - '0') * 10 + (s[6] - '0');
+	d = (s[8] - '0') * 10 + (s[9] - '0');
+	if (m < 1 || m > 12 || d < 1 || d > rtc_month_days(m - 1, y))
+		return -EINVAL;
+
+	*v = mktime64(y, m, d, 0, 0, 0) / (24 * 60 * 60) - FILTER_PG_EPOCH_DAYS;
+	return 0;
+}
+
+static int __parse_field(const struct filter_column *col, const char *s, uint32_t len,
+			 int32_t *v)
+{
+	switch (col->type) {
+	case NVME_FILTER_TYPE_INT4:
+	case NVME_FILTER_TYPE_INT8:
+		return __parse_decimal(s, len, 0, v);
+	case NVME_FILTER_TYPE_NUMERIC:
+		return __parse_decimal(s, len, col->scale, v);
+	case NVME_FILTER_TYPE_DATE:
+		return __parse_date(s, len, v);
+	}
+
+	*v = filter_text_prefix((const uint8_t *)s, len, col->type == NVME_FILTER_TYPE_BPCHAR);
+	return 0;
+}
+
+/*
+ * Decode the first nr_columns fields of a line into row @row of ctx->rows.
+ * Empty, missing and malformed fields are NULL. Returns false for empty lines.
+ */
+static bool __parse_line(struct filter_ctx *ctx, const char *line, uint32_t len, uint32_t row)
+{
+	uint32_t i, start = 0, nulls = 0;
+
+	if (len && line[len - 1] == '\r')
+		len--;
+	if (len == 0)
+		return false;
+
+	for (i = 0; i < ctx->nr_columns; i++) {
+		const char *field = line + start, *delim;
+		uint32_t field_len;
+		int32_t v = 0;
+
+		if (start > len) {
+			nulls |= 1U << i;
+			filter_row_put(ctx, row, i, 0);
+			continue;
+		}
+
+		delim = memchr(field, ctx->delim, len - start);
+		field_len = delim ? delim - field : len - start;
+		start += field_len + 1;
+
+		if (field_len == 0 || __parse_field(&ctx->columns[i], field, field_len, &v)) {
+			nulls |= 1U << i;
+			v = 0;
+		} else {
+			filter_like_row(ctx, row, i, (const uint8_t *)field, field_len);
+		}
+		filter_row_put(ctx, row, i, v);
+	}
+	filter_row_finish(ctx, row, nulls);
+
+	return true;
+}
+
+/*
+ * Delimited text, one record per line, such as the .tbl files of dbgen whose
+ * fields are all terminated by '|'. The scanned range starts at the beginning
+ * of a line and a trailing partial line is ignored. Parsing a line is
+ * accounted to the unit it starts in.
+ */
+static size_t __text_scan(struct filter_ctx *ctx, const void *data, size_t len)
+{
+	uint32_t offs[FILTER_BATCH], nr = 0;
+	const char *text = data;
+	const char *eol;
+	size_t pos;
+
+	for (pos = 0; pos < len; pos = eol - text + 1) {
+		eol = memchr(text + pos, '\n', len - pos);
+		if (!eol)
+			break;
+
+		filter_unit_at(ctx, pos)->cycles += (eol - text - pos + 1) * FILTER_CYCLES_PER_BYTE;
+
+		if (!__parse_line(ctx, text + pos, eol - text - pos, nr))
+			continue;
+
+		offs[nr++] = pos;
+		if (nr == FILTER_BATCH && !filter_rows_flush(ctx, &nr, offs))
+			return offs[ctx->stop_row];
+	}
+
+	if (!filter_rows_flush(ctx, &nr, offs))
+		return offs[ctx->stop_row];
+
+	return pos;
+}
+
+const struct filter_format filter_format_text = {
+	.name = "text",
+	.typed = true,
+	.cursor_align = 1,
+	.scan = __text_scan,
+};
@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include "nvmev.h"
+#include "filter.h"
+
+/*
+ * Top-K heaps. The root is the entry that goes first when a better record
+ * comes: the smallest one when the largest are kept, the largest otherwise.
+ */
+static int __cmp_desc(pqueue_pri_t next, pqueue_pri_t curr)
+{
+	return next > curr;
+}
+
+static int __cmp_asc(pqueue_pri_t next, pqueue_pri_t curr)
+{
+	return next < curr;
+}
+
+static pqueue_pri_t __get_pri(void *a)
+{
+	return ((struct filter_topk_entry *)a)->pri;
+}
+
+static void __set_pri(void *a, pqueue_pri_t pri)
+{
+	((struct filter_topk_entry *)a)->pri = pri;
+}
+
+static size_t __get_pos(void *a)
+{
+	return ((struct filter_topk_entry *)a)->pos;
+}
+
+static void __set_pos(void *a, size_t pos)
+{
+	((struct filter_topk_entry *)a)->pos = pos;
+}
+
+bool filter_topk_init(struct filter_topk *topk, struct filter_arena *arena, uint32_t k,
+		      uint32_t column, bool desc, uint32_t tuple_size)
+{
+	size_t entry_size = ALIGN(sizeof(struct filter_topk_entry) + tuple_size, sizeof(uint64_t));
+
+	*topk = (struct filter_topk){
+		.k = k,
+		.column = column,
+		.desc = desc,
+		.tuple_size = tuple_size,
+		.entry_size = entry_size,
+		.nr_entries = 0,
+	};
+
+	topk->entries = filter_arena_alloc(arena, (size_t)k * entry_size);
+	if (!topk->entries)
+		return false;
+
+	topk->heap = pqueue_init(k, desc ? __cmp_desc : __cmp_asc, __get_pri, __set_pri,
+				 __get_pos, __set_pos);
+
+	return topk->heap != NULL;
+}
+
+void filter_topk_free(struct filter_topk *topk)
+{
+	if (topk->heap)
+		pqueue_free(topk->heap);
+	topk->heap = NULL;
+}
+
+/* The priority of value @v, ordered as unsigned, NULL above all values */
+pqueue_pri_t filter_topk_pri(int32_t v, bool null)
+{
+	if (null)
+		return 1ULL << 32;
+
+	return (uint32_t)v ^ (1U << 31);
+}
+
+/*
+ * Where to store the tuple of a record of priority @pri if it is among the
+ * top K so far, evicting the root if there are K already. Returns NULL if
+ * it is not.
+ */
+void *filter_topk_slot(struct filter_topk *topk, pqueue_pri_t pri)
+{
+	struct filter_topk_entry *entry;
+
+	if (topk->nr_entries < topk->k) {
+		entry = topk->entries + (size_t)topk->nr_entries++ * topk->entry_size;
+		entry->pri = pri;
+		pqueue_insert(topk->heap, entry);
+		return entry->tuple;
+	}
+
+	entry = pqueue_peek(topk->heap);
+	if (!topk->heap->cmppri(pri, entry->pri))
+		return NULL;
+
+	pqueue_change_priority(topk->heap, pri, entry);
+	return entry->tuple;
+}
+
+/* The tuple of the entry that comes last of those left, NULL once there are none */
+const void *filter_topk_pop(struct filter_topk *topk)
+{
+	struct filter_topk_entry *entry = pqueue_pop(topk->heap);
+
+	return entry ? entry->tuple : NULL;
+}
@@ -0,0 +1,262 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <linux/jhash.h>
+#include <linux/moduleparam.h>
+#include <linux/vmalloc.h>
+
+#include "nvmev.h"
+#include "filter.h"
+
+static unsigned int zonemap_record_size;
+module_param(zonemap_record_size, uint, 0444);
+MODULE_PARM_DESC(zonemap_record_size, "Record size of the table to keep zone maps for (0: off)");
+static unsigned int zonemap_columns;
+module_param(zonemap_columns, uint, 0444);
+MODULE_PARM_DESC(zonemap_columns, "Bitmask of the columns to keep zone maps for");
+static unsigned int zonemap_bloom_budget;
+module_param(zonemap_bloom_budget, uint, 0444);
+MODULE_PARM_DESC(zonemap_bloom_budget, "Memory for per page Bloom filters in MiB (0: off)");
+
+static void __init_bloom(struct filter_zonemap *zm)
+{
+	uint64_t bits = (uint64_t)MB(zonemap_bloom_budget) * 8 / zm->nr_pgs;
+	uint32_t nr_vals = (zm->pgsz / zm->rec_size + 2) * zm->nr_cols;
+
+	zm->bloom_words = min_t(uint64_t, bits / 64, U16_MAX);
+	if (zm->bloom_words == 0) {
+		if (zonemap_bloom_budget)
+			NVMEV_ERROR("%s: budget too small for Bloom filters\n", __func__);
+		return;
+	}
+
+	zm->blooms = vmalloc(sizeof(uint64_t) * zm->bloom_words * zm->nr_pgs);
+	if (!zm->blooms) {
+		NVMEV_ERROR("%s: failed to allocate Bloom filters\n", __func__);
+		zm->bloom_words = 0;
+		return;
+	}
+	memset(zm->blooms, 0, sizeof(uint64_t) * zm->bloom_words * zm->nr_pgs);
+
+	/* k = m / n * ln 2 minimizes the false positive rate */
+	zm->bloom_hashes = clamp_t(uint32_t, zm->bloom_words * 64 * 69 / (100 * nr_vals), 1, 8);
+
+	NVMEV_INFO("filter: %u bit Bloom filters per page, %u hashes\n", zm->bloom_words * 64,
+		   zm->bloom_hashes);
+}
+
+void filter_zonemap_init(struct filter_zonemap *zm, uint64_t nr_pgs, uint32_t pgsz)
+{
+	uint64_t i;
+	uint32_t col;
+
+	*zm = (struct filter_zonemap){
+		.rec_size = 0,
+		.pgsz = pgsz,
+		.nr_pgs = nr_pgs,
+	};
+
+	if (zonemap_record_size == 0 || zonemap_columns == 0)
+		return;
+
+	for (col = 0; col < 32 && zm->nr_cols < FILTER_ZM_MAX_COLUMNS; col++) {
+		if (!(zonemap_columns & (1U << col)))
+			continue;
+
+		if ((col + 1) * NVME_FILTER_COLUMN_SIZE > zonemap_record_size) {
+			NVMEV_ERROR("%s: column %u out of record\n", __func__, col);
+			return;
+		}
+		zm->cols[zm->nr_cols++] = col;
+	}
+
+	zm->zones = vmalloc(sizeof(struct filter_zone) * zm->nr_cols * nr_pgs);
+	if (!zm->zones) {
+		NVMEV_ERROR("%s: failed to allocate zone maps\n", __func__);
+		return;
+	}
+
+	/* pages without records have an empty range */
+	for (i = 0; i < nr_pgs * zm->nr_cols; i++)
+		zm->zones[i] = (struct filter_zone){ .min = S32_MAX, .max = S32_MIN };
+
+	zm->rec_size = zonemap_record_size;
+	__init_bloom(zm);
+
+	NVMEV_INFO("filter: zone maps on %u columns of %u byte records\n", zm->nr_cols,
+		   zm->rec_size);
+}
+
+void filter_zonemap_exit(struct filter_zonemap *zm)
+{
+	vfree(zm->zones);
+	vfree(zm->blooms);
+	zm->zones = NULL;
+	zm->blooms = NULL;
+	zm->rec_size = 0;
+	zm->bloom_words = 0;
+}
+
+/* The bits of a value in the Bloom filter of a page are found by double hashing */
+static inline uint32_t __bloom_bit(struct filter_zonemap *zm, uint32_t h1, uint32_t h2, uint32_t i)
+{
+	return (h1 + i * h2) % (zm->bloom_words * 64);
+}
+
+static void __bloom_add(struct filter_zonemap *zm, uint64_t *bloom, uint32_t col, int32_t v)
+{
+	uint32_t h1 = jhash_2words(v, col, 0);
+	uint32_t h2 = jhash_2words(v, col, h1) | 1;
+	uint32_t i, bit;
+
+	for (i = 0; i < zm->bloom_hashes; i++) {
+		bit = __bloom_bit(zm, h1, h2, i);
+		bloom[bit / 64] |= 1ULL << (bit % 64);
+	}
+}
+
+static bool __bloom_test(struct filter_zonemap *zm, uint64_t *bloom, uint32_t col, int32_t v)
+{
+	uint32_t h1 = jhash_2words(v, col, 0);
+	uint32_t h2 = jhash_2words(v, col, h1) | 1;
+	uint32_t i, bit;
+
+	for (i = 0; i < zm->bloom_hashes; i++) {
+		bit = __bloom_bit(zm, h1, h2, i);
+		if (!(bloom[bit / 64] & (1ULL << (bit % 64))))
+			return false;
+	}
+
+	return true;
+}
+
+static inline uint64_t *__page_bloom(struct filter_zonemap *zm, uint64_t lpn)
+{
+	return zm->bloom_words ? &zm->blooms[lpn * zm->bloom_words] : NULL;
+}
+
+static void __update_page(struct filter_zonemap *zm, const void *mapped, uint64_t lpn)
+{
+	struct filter_zone *zones = &zm->zones[lpn * zm->nr_cols];
+	uint64_t nr_recs = zm->nr_pgs * zm->pgsz / zm->rec_size;
+	uint64_t *bloom = __page_bloom(zm, lpn);
+	uint64_t rec, first, last;
+	uint32_t i;
+
+	for (i = 0; i < zm->nr_cols; i++)
+		zones[i] = (struct filter_zone){ .min = S32_MAX, .max = S32_MIN };
+	if (bloom)
+		memset(bloom, 0, sizeof(uint64_t) * zm->bloom_words);
+
+	/* every complete record overlapping the page */
+	first = lpn * zm->pgsz / zm->rec_size;
+	if (first >= nr_recs)
+		return;
+	last = min(((lpn + 1) * zm->pgsz - 1) / zm->rec_size, nr_recs - 1);
+
+	for (rec = first; rec <= last; rec++) {
+		const void *r = mapped + rec * zm->rec_size;
+
+		for (i = 0; i < zm->nr_cols; i++) {
+			int32_t v = filter_get_column(r, zm->cols[i]);
+
+			zones[i].min = min(zones[i].min, v);
+			zones[i].max = max(zones[i].max, v);
+			if (bloom)
+				__bloom_add(zm, bloom, i, v);
+		}
+	}
+}
+
+/*
+ * Recompute the zone maps of the pages sharing records with the bytes
+ * [offs, offs + len) that have just been written to @mapped.
+ */
+void filter_zonemap_update(struct filter_zonemap *zm, const void *mapped, uint64_t offs,
+			   uint64_t len)
+{
+	uint64_t start = rounddown(offs, zm->rec_size);
+	uint64_t end = roundup(offs + len, zm->rec_size);
+	uint64_t lpn;
+
+	end = min(end, zm->nr_pgs * zm->pgsz);
+	for (lpn = start / zm->pgsz; lpn < DIV_ROUND_UP(end, zm->pgsz); lpn++)
+		__update_page(zm, mapped, lpn);
+}
+
+static bool __zone_may_match(struct filter_zone *zone, struct filter_pred *pred)
+{
+	if (zone->min > zone->max)
+		return false;
+
+	switch (pred->op) {
+	case NVME_FILTER_OP_EQ:
+		return zone->min <= pred->value && pred->value <= zone->max;
+	case NVME_FILTER_OP_NE:
+		return !(zone->min == pred->value && zone->max == pred->value);
+	case NVME_FILTER_OP_LT:
+		return zone->min < pred->value;
+	case NVME_FILTER_OP_LE:
+		return zone->min <= pred->value;
+	case NVME_FILTER_OP_GT:
+		return zone->max > pred->value;
+	case NVME_FILTER_OP_GE:
+		return zone->max >= pred->value;
+	case NVME_FILTER_OP_BETWEEN:
+		return zone->max >= pred->value && zone->min <= pred->high;
+	}
+
+	return true;
+}
+
+static bool __pred_may_match(struct filter_zonemap *zm, struct filter_zone *zones,
+			     uint64_t *bloom, struct filter_pred *pred)
+{
+	uint32_t i;
+
+	for (i = 0; i < zm->nr_cols; i++) {
+		if (zm->cols[i] != pred->column)
+			continue;
+
+		if (!__zone_may_match(&zones[i], pred))
+			return false;
+
+		if (bloom && pred->op == NVME_FILTER_OP_EQ)
+			return __bloom_test(zm, bloom, i, pred->value);
+
+		return true;
+	}
+
+	/* nothing is known about the column */
+	return true;
+}
+
+/* Returns false if no record overlapping page @lpn can satisfy @prog */
+bool filter_zonemap_may_match(struct filter_zonemap *zm, struct filter_prog *prog, uint64_t lpn)
+{
+	struct filter_zone *zones = &zm->zones[lpn * zm->nr_cols];
+	uint64_t *bloom = __page_bloom(zm, lpn);
+	bool term = true;
+	uint32_t i;
+
+	for (i = 0; i < prog->nr_preds; i++) {
+		struct filter_pred *pred = &prog->preds[i];
+
+		if (pred->new_term) {
+			if (term)
+				return true;
+			term = true;
+		}
+
+		if (term)
+			term = __pred_may_match(zm, zones, bloom, pred);
+	}
+
+	return term;
+}
+
+/* Whether the zone maps describe the records scanned from byte @offs on */
+bool filter_zonemap_applies(struct filter_zonemap *zm, struct filter_ctx *ctx, uint64_t offs)
+{
+	return filter_zonemap_enabled(zm) && ctx->format == NVME_FILTER_FMT_FLAT &&
+	       zm->rec_size == ctx->rec_size && offs % zm->rec_size == 0;
+}
@@ -61,9 +61,9 @@ static unsigned int __do_perform_io(int sqid, int sq_entry)
 	remaining = length;
 
 	// filter指令不在此处执行
-	// if (cmd->opcode == nvme_cmd_filter)
-		// return length;
-		
+	if (cmd->opcode == nvme_cmd_filter)
+		return length;
+
 	while (remaining) {
 		size_t io_size;
 		void *vaddr;
@@ -132,6 +132,10 @@ static unsigned int __do_perform_io_using_dma(int sqid, int sq_entry)
 	length = __cmd_io_size(cmd);
 	remaining = length;
 
+	/* filter commands move their data while being processed by the FTL */
+	if (cmd->opcode == nvme_cmd_filter)
+		return length;
+
 	memset(paddr_list, 0, sizeof(paddr_list));
 	/* Loop to get the PRP list */
 	while (remaining) {
@@ -305,8 +309,10 @@ static void __enqueue_io_req(int sqid, int cqid, int sq_entry, unsigned long lon
 	w->nsecs_enqueue = local_clock();
 	w->nsecs_target = ret->nsecs_target;
 	w->status = ret->status;
+	w->result0 = ret->result0;
+	w->result1 = ret->result1;
 	w->is_completed = false;
-	w->is_copied = false;
+	w->is_copied = ret->is_copied;
 	w->prev = -1;
 	w->next = -1;
 
@@ -420,6 +426,9 @@ static size_t __nvmev_proc_io(int sqid, int sq_entry, size_t *io_size)
 	struct nvmev_result ret = {
 		.nsecs_target = nsecs_start,
 		.status = NVME_SC_SUCCESS,
+		.result0 = 0,
+		.result1 = 0,
+		.is_copied = false,
 	};
 
 #ifdef PERF_DEBUG
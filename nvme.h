@@ -348,13 +348,15 @@ struct nvme_filter_command {
 	__u8 flags;
 	__u16 command_id;
 	__le32 nsid;
-	__u64 rsvd2;
+	__le16 record_size; /* bytes per record */
+	__le16 filter_flags; /* enum nvme_filter_flags */
+	__le32 proj_mask; /* columns to return, whole records if 0 */
 	__le64 metadata;
 	__le64 prp1;
 	__le64 prp2;
 	__le64 slba;
 	__le16 length;
-	__le16 filter_factor;
+	__le16 filter_factor; /* obsolete, selectivity is measured by the device */
 	__le32 filter_index;
 	__le32 filter_op;
 	__le32 filter_const;
@@ -483,6 +485,8 @@ enum nvme_admin_opcode {
 	nvme_admin_sanitize_nvm = 0x84,
 	nvme_admin_get_lba_status = 0x86,
 	nvme_admin_vendor_start = 0xC0,
+	nvme_admin_filter_table = 0xC0,
+	nvme_admin_filter_bloom = 0xC1,
 };
 
 enum {
@@ -520,6 +524,7 @@ enum {
 	NVME_LOG_ANA = 0x0c,
 	NVME_LOG_DISC = 0x70,
 	NVME_LOG_RESERVATION = 0x80,
+	NVME_LOG_FILTER_TABLES = 0xC0,
 	NVME_FWACT_REPL = (0 << 3),
 	NVME_FWACT_REPL_ACTV = (1 << 3),
 	NVME_FWACT_ACTV = (2 << 3),
@@ -0,0 +1,469 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef _NVME_FILTER_H
+#define _NVME_FILTER_H
+
+#include "nvme.h"
+
+/*
+ * Filter (predicate pushdown) command set.
+ *
+ * The LBA range [slba, slba + length] holds an array of fixed-width records of
+ * nvme_filter_command.record_size bytes each. Column N of a record is the
+ * little-endian 32-bit integer at byte offset (N * 4). Records for which
+ * "column[filter_index] <filter_op> filter_const" holds are packed into the
+ * host buffer described by PRP1/PRP2, and the number of bytes returned is
+ * reported in result0 of the completion. The command fails with
+ * NVME_SC_CAP_EXCEEDED if they do not all fit, unless it is streaming.
+ *
+ * With NVME_FILTER_FLAG_DESC set in filter_flags, filter_index, filter_op and
+ * filter_const are ignored and the metadata pointer holds the host address of
+ * a struct nvme_filter_desc instead. Its clauses form a predicate program in
+ * disjunctive normal form: consecutive clauses are ANDed, and a clause with
+ * NVME_FILTER_CLAUSE_OR set starts a new term that is ORed with the previous
+ * ones, so AND binds tighter than OR as in SQL.
+ *
+ * Projection: instead of whole records, only the columns selected by
+ * proj_mask (bit N selects column N) are returned, packed in column order.
+ * A descriptor with nr_proj != 0 overrides proj_mask with an explicit list of
+ * columns, which may also reorder them. The amount reported in result0 is the
+ * size of the projected tuples.
+ *
+ * Aggregation: a descriptor with nr_aggs != 0 folds the matching records into
+ * its aggregates instead of returning them. Once the scan is done, one struct
+ * nvme_filter_agg_result per aggregate is written to the host buffer, and
+ * result0/result1 hold the low/high dwords of the first aggregate's value.
+ * AVG reports the sum and the count so that the host can divide exactly.
+ * Projection is ignored in this mode.
+ *
+ * Grouping: with nr_group_keys != 0 as well, the aggregates are computed per
+ * distinct value of the group key columns, in a hash table whose size is
+ * bounded by the memory of the device and by the host buffer. A NULL key is
+ * a group of its own, as in SQL, apart from the value 0 it reads as. Each
+ * group is returned as its key columns (__le32 each), then a __le32 bitmap
+ * with bit i set if key i is NULL, zero padded to a multiple of 8 bytes,
+ * followed by one struct nvme_filter_agg_result per aggregate.
+ * result0 holds the number of groups. Matching records whose group does not
+ * fit anymore are returned unchanged ahead of the groups, for the host to
+ * aggregate itself; result1 holds their size in bytes, so a non-zero value
+ * signals the overflow. The command fails with NVME_SC_CAP_EXCEEDED if they
+ * do not fit in the host buffer along with the groups.
+ *
+ * Formats: the descriptor's format selects how the range is laid out. With
+ * anything but NVME_FILTER_FMT_FLAT and NVME_FILTER_FMT_BLOCKS, record_size
+ * is ignored and the device
+ * decodes every record it finds into one of nr_columns + 1 __le32 columns,
+ * described by columns[]: the first nr_columns attributes or fields in
+ * order, then a bitmap with bit N set if column N is NULL. Integers and
+ * dates (days since 2000-01-01) keep their value, INT8 values are clamped to
+ * 32 bits, NUMERIC values are scaled by 10^scale and truncated, and
+ * BPCHAR/VARCHAR values are their first four bytes, big-endian and zero
+ * padded, trailing blanks of BPCHAR removed. A NULL column reads as 0,
+ * satisfies no clause and is skipped by all aggregates but COUNT.
+ *
+ * NVME_FILTER_FMT_PG_HEAP reads PostgreSQL heap pages, 8 KiB each and the
+ * first one at slba. Compressed or out of line (TOAST) values and NUMERIC
+ * NaN/infinities read as NULL. Visibility is judged from the hint bits only,
+ * so tuples inserted by an aborted transaction or deleted by a committed one
+ * are not known to be dead until the database has set them.
+ *
+ * NVME_FILTER_FMT_TEXT reads lines of fields separated by delim ('|' if 0),
+ * as in the .tbl files of dbgen, the first one at slba. Dates are written
+ * YYYY-MM-DD. Fields are not quoted; empty, missing or malformed ones are
+ * NULL. A trailing partial line is ignored.
+ *
+ * NVME_FILTER_FMT_BLOCKS reads fixed-width records of record_size bytes, as
+ * NVME_FILTER_FMT_FLAT does, stored in blocks that may be compressed. A
+ * block starts with a struct nvme_filter_block, the first one at slba and
+ * each other one at the first multiple of NVME_FILTER_BLOCK_ALIGN bytes past
+ * the end of the previous one. Decompressed, it holds nr_records records,
+ * fewer than NVME_FILTER_BLOCK_ALIGN, of at most NVME_FILTER_BLOCK_MAX_SIZE
+ * bytes in all. The payload of NVME_FILTER_CODEC_NONE is the records, that
+ * of NVME_FILTER_CODEC_LZ4 the records compressed in the LZ4 block format,
+ * and that of NVME_FILTER_CODEC_DICT every column in turn: a struct
+ * nvme_filter_dict, then nr_records __le32 values if nr_values is 0, or
+ * else nr_values distinct __le32 values in ascending order followed by the
+ * nr_records __u8 indexes of the values of the column among them, zero
+ * padded to a multiple of 4 bytes. record_size must then be a multiple of 4.
+ * Blocks that cannot be decoded, zeroed ones included, are skipped.
+ *
+ * Tables: instead of describing the layout in every command, the host can
+ * register it once with the nvme_admin_filter_table admin command. PRP1
+ * points to a struct nvme_filter_table for NVME_FILTER_TABLE_REGISTER, and
+ * the id assigned to the table is returned in result0. A filter command
+ * with NVME_FILTER_FLAG_TABLE set refers to table filter_index, takes
+ * record_size, the format and the columns from it, and must stay within the
+ * extent of the table on the same namespace. Its predicates are given by a
+ * descriptor. The registered tables are listed by log page
+ * NVME_LOG_FILTER_TABLES as a struct nvme_filter_table_log.
+ *
+ * Streaming: with NVME_FILTER_FLAG_STREAM (and a descriptor), the command
+ * scans an extent of any size, the extent of its table or stream_nlb blocks
+ * from slba, and [slba, slba + length] only sizes the host buffer. The
+ * device scans from the cursor given by filter_op/filter_const (low/high
+ * dwords, 0 to start) until the host buffer is full, the group table is
+ * full or it has scanned a firmware defined amount, and completes with the
+ * cursor to resubmit with in result0/result1, or NVME_FILTER_CURSOR_DONE
+ * once the extent has been scanned. The host buffer then starts with a
+ * struct nvme_filter_stream_hdr holding what result0/result1 would have
+ * held otherwise. Aggregates and groups are those of the part scanned, for
+ * the host to merge, and records whose group does not fit end the part
+ * instead of being spilled. A buffer too small for a single result fails
+ * the command with NVME_SC_CAP_EXCEEDED.
+ *
+ * Selection: a descriptor whose output is NVME_FILTER_OUT_BITMAP or
+ * NVME_FILTER_OUT_ROWIDS returns which records match rather than their
+ * columns, for the host to fetch them later. Records are numbered from 0 in the order they are found in the
+ * scanned range (from the cursor when streaming), skipping dead tuples and
+ * empty lines. NVME_FILTER_OUT_BITMAP returns a bitmap with bit N (bit N % 8
+ * of byte N / 8) set if record N matches, NVME_FILTER_OUT_ROWIDS the numbers
+ * of the matching records as __le32 values in increasing order. result0
+ * holds the bytes returned and result1 the number of records the output
+ * covers, which is less than those scanned if the host buffer filled up.
+ * Aggregates cannot be combined with these modes.
+ *
+ * Patterns: clauses with NVME_FILTER_OP_LIKE or NVME_FILTER_OP_NOT_LIKE
+ * match a BPCHAR or VARCHAR column of a typed format against the SQL LIKE
+ * pattern patterns[value[0]] of the descriptor. '%' matches any number of
+ * bytes and '_' a single one; there is no escape character, and matching is
+ * case sensitive. The whole value is matched, trailing blanks of BPCHAR
+ * removed, not just the prefix held in its column. At most
+ * NVME_FILTER_MAX_PATTERNS such clauses are allowed per command.
+ *
+ * Typed constants: NVME_FILTER_OP_BETWEEN holds if value[0] <= column <=
+ * value[1], and needs a descriptor. The constants of a clause are compared
+ * as given, the low 32 bits of value[], unless its column has a type that
+ * they can be converted from. On a DATE column, NVME_FILTER_CLAUSE_UNIX_DATE
+ * gives them as days since 1970-01-01 rather than since 2000-01-01. On a
+ * NUMERIC column, NVME_FILTER_CLAUSE_SCALE gives them as signed 64-bit
+ * decimals with scale digits after the point, which the device rescales to
+ * the scale of the column, rounding the bound so that the same values are
+ * selected.
+ *
+ * Top-K: a descriptor with limit != 0 returns only the limit matching
+ * records, or their projected columns, that come first when ordered by
+ * order_column, descending if order_desc is set. They are returned in that
+ * order once the scan is done, NULL values sorting as larger than any other
+ * as in PostgreSQL (last ascending, first descending), and ties in no
+ * particular order. result0 holds the bytes returned and result1 the number
+ * of matching records. Aggregates and the selection outputs cannot be
+ * combined with it.
+ *
+ * Semi-joins: the host can load a Bloom filter, such as one of the join
+ * keys of the other side of a join, with the nvme_admin_filter_bloom admin
+ * command. For NVME_FILTER_BLOOM_LOAD, PRP1/PRP2 point to a struct
+ * nvme_filter_bloom followed by its nr_words __le64 words of bits, bit N
+ * being bit N % 64 of word N / 64, and the id assigned to the filter is
+ * returned in result0. Value v sets bits (h1 + i * h2) mod (nr_words * 64)
+ * for i < nr_hashes, computed in 32 bits, where h1 = hashword(v, seed) and
+ * h2 = hashword(v, h1) | 1, hashword() being that of Bob Jenkins' lookup3
+ * on the single 32-bit word v. A clause with NVME_FILTER_OP_IN_BLOOM holds
+ * if all the bits of the value of its column in filter value[0] are set,
+ * and needs a descriptor. Filters stay loaded until dropped.
+ *
+ * Partitioning: a descriptor with nr_parts != 0 splits the matching records,
+ * or their projected columns, among nr_parts regions of the host buffer,
+ * parts[], for as many host threads to join them. A record goes to region
+ * (hashword(v, part_seed) * nr_parts) >> 32, computed in 64 bits, v being
+ * the value of its column part_column, projected or not. Each region starts
+ * with a struct nvme_filter_part_hdr, written once the scan is done, and
+ * regions must not overlap. A record that does not fit in its region fails
+ * the command with NVME_SC_CAP_EXCEEDED, or ends the part scanned when
+ * streaming. result0 holds the bytes of records returned and result1 their
+ * number. Aggregates, Top-K and the selection outputs cannot be
+ * combined with it.
+ *
+ * Sampling: a descriptor with sample set to NVME_FILTER_SAMPLE_PAGES keeps
+ * the records of a random subset of the pages scanned only, each page being
+ * in it with probability sample_rate / NVME_FILTER_SAMPLE_SCALE, and the
+ * pages out of it are not read. Pages are logical pages of the device, or
+ * PostgreSQL heap pages with NVME_FILTER_FMT_PG_HEAP, and a record is in the
+ * page it starts in, or with NVME_FILTER_FMT_BLOCKS the page its block ends
+ * in. NVME_FILTER_SAMPLE_ROWS keeps every record with that probability
+ * instead, and reads all the pages. Records out of the sample are handled
+ * as records that do not match. Whether a page or record is in the sample
+ * depends on sample_seed and its position in the namespace only, so that a
+ * stream draws the same sample as a single command would. The host buffer
+ * then starts with a struct nvme_filter_sample_hdr, after the header of a
+ * stream, which result0 does not count.
+ *
+ * Statistics: NVME_FILTER_OUT_STATS returns, instead of the matching
+ * records, a struct nvme_filter_stats per projected column, or per column
+ * of the record if none is, for the host to build optimizer statistics
+ * from, as ANALYZE does. It holds the number of NULL and other values,
+ * their minimum and maximum, and the number of distinct values estimated
+ * with a HyperLogLog sketch whose registers it also holds, for the host to
+ * merge with those of other commands, such as the other parts of a stream,
+ * by keeping the largest of each. With nr_buckets != 0, it is followed by
+ * the nr_buckets + 1 bounds of an equi-depth histogram of the values, as
+ * __le32, zero padded to a multiple of 8 bytes: the minimum, the values
+ * splitting a uniform sample of a firmware defined number of them into
+ * nr_buckets parts of the same size, and the maximum. nr_bounds of them are
+ * set, fewer if there are fewer values. The device memory used does not
+ * depend on the number of records. result0 holds the bytes returned and
+ * result1 the number of matching records. A descriptor with no clauses
+ * matches all the records.
+ */
+enum nvme_filter_op {
+	NVME_FILTER_OP_EQ = 0x0,
+	NVME_FILTER_OP_NE = 0x1,
+	NVME_FILTER_OP_LT = 0x2,
+	NVME_FILTER_OP_LE = 0x3,
+	NVME_FILTER_OP_GT = 0x4,
+	NVME_FILTER_OP_GE = 0x5,
+	NVME_FILTER_OP_LIKE = 0x6, /* value[0] is the index of the pattern */
+	NVME_FILTER_OP_NOT_LIKE = 0x7,
+	NVME_FILTER_OP_BETWEEN = 0x8, /* value[0] <= column <= value[1] */
+	NVME_FILTER_OP_IN_BLOOM = 0x9, /* value[0] is the id of the Bloom filter */
+	NVME_FILTER_OP_NR,
+};
+
+enum nvme_filter_agg_func {
+	NVME_FILTER_AGG_COUNT = 0x0,
+	NVME_FILTER_AGG_SUM = 0x1,
+	NVME_FILTER_AGG_MIN = 0x2,
+	NVME_FILTER_AGG_MAX = 0x3,
+	NVME_FILTER_AGG_AVG = 0x4,
+	NVME_FILTER_AGG_NR,
+};
+
+enum nvme_filter_format {
+	NVME_FILTER_FMT_FLAT = 0x0, /* array of fixed-width records */
+	NVME_FILTER_FMT_PG_HEAP = 0x1, /* PostgreSQL heap pages */
+	NVME_FILTER_FMT_TEXT = 0x2, /* delimited text, one record per line */
+	NVME_FILTER_FMT_BLOCKS = 0x3, /* blocks of fixed-width records, maybe compressed */
+	NVME_FILTER_FMT_NR,
+};
+
+enum nvme_filter_codec {
+	NVME_FILTER_CODEC_NONE = 0x0,
+	NVME_FILTER_CODEC_LZ4 = 0x1,
+	NVME_FILTER_CODEC_DICT = 0x2, /* dictionary-encoded columns */
+	NVME_FILTER_CODEC_NR,
+};
+
+/* column types of the formats other than NVME_FILTER_FMT_FLAT */
+enum nvme_filter_type {
+	NVME_FILTER_TYPE_INT4 = 0x0,
+	NVME_FILTER_TYPE_INT8 = 0x1,
+	NVME_FILTER_TYPE_DATE = 0x2,
+	NVME_FILTER_TYPE_NUMERIC = 0x3,
+	NVME_FILTER_TYPE_BPCHAR = 0x4,
+	NVME_FILTER_TYPE_VARCHAR = 0x5, /* also TEXT */
+	NVME_FILTER_TYPE_NR,
+};
+
+#define NVME_FILTER_COLUMN_SIZE (4)
+
+enum nvme_filter_sample {
+	NVME_FILTER_SAMPLE_NONE = 0x0,
+	NVME_FILTER_SAMPLE_PAGES = 0x1,
+	NVME_FILTER_SAMPLE_ROWS = 0x2, /* Bernoulli sample of the records */
+	NVME_FILTER_SAMPLE_NR,
+};
+
+enum nvme_filter_output {
+	NVME_FILTER_OUT_ROWS = 0x0, /* matching records or their projected columns */
+	NVME_FILTER_OUT_BITMAP = 0x1,
+	NVME_FILTER_OUT_ROWIDS = 0x2,
+	NVME_FILTER_OUT_STATS = 0x3, /* statistics of the columns of the matching records */
+	NVME_FILTER_OUT_NR,
+};
+
+enum nvme_filter_flags {
+	NVME_FILTER_FLAG_DESC = 1 << 0, /* predicates are given by a descriptor */
+	NVME_FILTER_FLAG_TABLE = 1 << 1, /* filter_index is a registered table */
+	NVME_FILTER_FLAG_STREAM = 1 << 2, /* scan an extent over several commands */
+};
+
+enum nvme_filter_clause_flags {
+	NVME_FILTER_CLAUSE_OR = 1 << 0, /* ORed with the clauses before it */
+	NVME_FILTER_CLAUSE_SCALE = 1 << 1, /* value[] has scale decimal digits */
+	NVME_FILTER_CLAUSE_UNIX_DATE = 1 << 2, /* value[] are days since 1970-01-01 */
+};
+
+#define NVME_FILTER_MAX_CLAUSES (16)
+#define NVME_FILTER_MAX_PROJ (32)
+#define NVME_FILTER_MAX_AGGS (8)
+#define NVME_FILTER_MAX_GROUP_KEYS (4)
+#define NVME_FILTER_MAX_COLUMNS (31)
+#define NVME_FILTER_MAX_TABLES (15)
+#define NVME_FILTER_CURSOR_DONE (~0ULL)
+#define NVME_FILTER_MAX_PATTERNS (8)
+#define NVME_FILTER_MAX_PATTERN_LEN (62)
+#define NVME_FILTER_MAX_BLOOMS (16)
+#define NVME_FILTER_MAX_PARTS (64)
+#define NVME_FILTER_BLOCK_ALIGN (4096)
+#define NVME_FILTER_BLOCK_MAX_SIZE (65536) /* of the records of a block */
+#define NVME_FILTER_DICT_MAX_VALUES (256)
+#define NVME_FILTER_SAMPLE_SCALE (1000000) /* sample_rate of a full sample */
+#define NVME_FILTER_MAX_BUCKETS (128)
+#define NVME_FILTER_HLL_BITS (10) /* of the hash selecting a HyperLogLog register */
+#define NVME_FILTER_HLL_REGS (1 << NVME_FILTER_HLL_BITS)
+
+struct nvme_filter_clause {
+	__le16 column;
+	__u8 op; /* enum nvme_filter_op */
+	__u8 flags; /* enum nvme_filter_clause_flags */
+	__u8 scale; /* with NVME_FILTER_CLAUSE_SCALE */
+	__u8 rsvd5[3];
+	__le64 value[2]; /* value[0] is the constant, value[1] the upper bound of BETWEEN */
+};
+
+struct nvme_filter_agg {
+	__u8 func; /* enum nvme_filter_agg_func */
+	__u8 rsvd1;
+	__le16 column; /* ignored by COUNT */
+};
+
+struct nvme_filter_column {
+	__u8 type; /* enum nvme_filter_type */
+	__u8 scale; /* decimal digits kept of a NUMERIC */
+	__le16 rsvd2;
+};
+
+struct nvme_filter_pattern {
+	__u8 len;
+	__u8 rsvd1;
+	char pattern[NVME_FILTER_MAX_PATTERN_LEN];
+};
+
+struct nvme_filter_part {
+	__le32 offs; /* in the host buffer */
+	__le32 size;
+};
+
+struct nvme_filter_desc {
+	__le16 nr_clauses;
+	__le16 nr_proj;
+	__le16 nr_aggs;
+	__le16 nr_group_keys;
+	__u8 format; /* enum nvme_filter_format */
+	__u8 nr_columns;
+	__u8 delim; /* field separator of NVME_FILTER_FMT_TEXT */
+	__u8 output; /* enum nvme_filter_output */
+	__u8 rsvd12[4];
+	struct nvme_filter_clause clauses[NVME_FILTER_MAX_CLAUSES];
+	__le16 proj[NVME_FILTER_MAX_PROJ]; /* columns to return, in output order */
+	struct nvme_filter_agg aggs[NVME_FILTER_MAX_AGGS];
+	__le16 group_keys[NVME_FILTER_MAX_GROUP_KEYS]; /* columns */
+	struct nvme_filter_column columns[NVME_FILTER_MAX_COLUMNS];
+	__u8 rsvd628[4];
+	__le64 stream_nlb; /* blocks of the extent streamed, unless it is a table */
+	struct nvme_filter_pattern patterns[NVME_FILTER_MAX_PATTERNS];
+	__le32 limit; /* records returned by Top-K, 0 for all */
+	__le16 order_column;
+	__u8 order_desc;
+	__u8 rsvd1159;
+	__le16 nr_parts; /* 0 to return all records together */
+	__le16 part_column;
+	__le32 part_seed;
+	struct nvme_filter_part parts[NVME_FILTER_MAX_PARTS];
+	__u8 sample; /* enum nvme_filter_sample */
+	__u8 rsvd1681[3];
+	__le32 sample_rate; /* in NVME_FILTER_SAMPLE_SCALE */
+	__le32 sample_seed;
+	__le16 nr_buckets; /* of the histograms of NVME_FILTER_OUT_STATS */
+	__u8 rsvd1694[2402];
+};
+
+enum nvme_filter_table_action {
+	NVME_FILTER_TABLE_REGISTER = 0x0,
+	NVME_FILTER_TABLE_UNREGISTER = 0x1, /* table id in cdw11 */
+};
+
+/* cdw10 of nvme_admin_filter_table is an enum nvme_filter_table_action */
+struct nvme_filter_table {
+	__le32 nsid; /* set by the device */
+	__le16 id; /* set by the device */
+	__le16 record_size; /* NVME_FILTER_FMT_FLAT and NVME_FILTER_FMT_BLOCKS only */
+	__u8 format; /* enum nvme_filter_format */
+	__u8 nr_columns;
+	__u8 delim;
+	__u8 rsvd11[5];
+	__le64 slba;
+	__le64 nlb; /* number of logical blocks */
+	struct nvme_filter_column columns[NVME_FILTER_MAX_COLUMNS];
+	__u8 rsvd156[100];
+};
+
+struct nvme_filter_table_log {
+	__le16 nr_tables;
+	__u8 rsvd2[254];
+	struct nvme_filter_table tables[NVME_FILTER_MAX_TABLES];
+};
+
+enum nvme_filter_bloom_action {
+	NVME_FILTER_BLOOM_LOAD = 0x0,
+	NVME_FILTER_BLOOM_DROP = 0x1, /* filter id in cdw11 */
+};
+
+/* cdw10 of nvme_admin_filter_bloom is an enum nvme_filter_bloom_action */
+struct nvme_filter_bloom {
+	__le32 nr_words; /* 64-bit words of bits that follow */
+	__u8 nr_hashes;
+	__u8 rsvd5[3];
+	__le32 seed;
+	__u8 rsvd12[52];
+};
+
+/* header of a block of NVME_FILTER_FMT_BLOCKS */
+struct nvme_filter_block {
+	__u8 codec; /* enum nvme_filter_codec */
+	__u8 rsvd1;
+	__le16 nr_records;
+	__le32 size; /* of the payload that follows */
+};
+
+/* header of a column of a block of NVME_FILTER_CODEC_DICT */
+struct nvme_filter_dict {
+	__le16 nr_values; /* 0 if the column is not encoded */
+	__le16 rsvd2;
+};
+
+struct nvme_filter_stream_hdr {
+	__le32 result0;
+	__le32 result1;
+	__le64 nr_bytes; /* returned after this header */
+};
+
+struct nvme_filter_part_hdr {
+	__le32 nr_bytes; /* of records, returned after this header */
+	__le32 nr_rows;
+};
+
+struct nvme_filter_sample_hdr {
+	__le64 nr_pages; /* scanned */
+	__le64 nr_sampled; /* of those in the sample, read unless zone maps rule them out */
+};
+
+struct nvme_filter_stats {
+	__le16 column;
+	__le16 nr_bounds; /* of the histogram that follows */
+	__le32 rsvd4;
+	__le64 nr_values; /* not NULL */
+	__le64 nr_nulls;
+	__le64 nr_distinct; /* estimated, of the values not NULL */
+	__le32 min; /* undefined if nr_values is 0 */
+	__le32 max;
+	__u8 hll[NVME_FILTER_HLL_REGS]; /* HyperLogLog registers */
+};
+
+struct nvme_filter_agg_result {
+	__le64 value; /* the sum for AVG, undefined for MIN/MAX if count is 0 */
+	__le64 count; /* number of records folded */
+};
+
+static_assert(sizeof(struct nvme_filter_clause) == 24);
+static_assert(sizeof(struct nvme_filter_pattern) == 64);
+static_assert(sizeof(struct nvme_filter_part) == 8);
+static_assert(sizeof(struct nvme_filter_desc) == 4096);
+static_assert(sizeof(struct nvme_filter_table) == 256);
+static_assert(sizeof(struct nvme_filter_table_log) == 4096);
+static_assert(sizeof(struct nvme_filter_bloom) == 64);
+static_assert(sizeof(struct nvme_filter_block) == 8);
+static_assert(sizeof(struct nvme_filter_dict) == 4);
+static_assert(sizeof(struct nvme_filter_sample_hdr) == 16);
+static_assert(sizeof(struct nvme_filter_stats) == 40 + NVME_FILTER_HLL_REGS);
+
+#endif
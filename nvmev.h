@@ -323,7 +323,10 @@ struct nvmev_request {
 
 struct nvmev_result {
 	uint32_t status;
+	uint32_t result0;
+	uint32_t result1;
 	uint64_t nsecs_target;
+	bool is_copied; /* the data was transferred while processing the command */
 };
 
 struct nvmev_ns {
@@ -127,6 +127,9 @@ void ssd_init_params(struct ssdparams *spp, uint64_t capacity, uint32_t nparts)
 	spp->ch_bandwidth = NAND_CHANNEL_BANDWIDTH;
 	spp->pcie_bandwidth = PCIE_BANDWIDTH;
 
+	spp->nr_cores = NR_COMPUTE_CORES;
+	spp->core_freq = COMPUTE_CORE_FREQ;
+
 	spp->write_buffer_size = GLOBAL_WB_SIZE;
 	spp->write_early_completion = WRITE_EARLY_COMPLETION;
 
@@ -310,6 +313,9 @@ void ssd_init(struct ssd *ssd, struct ssdparams *spp, uint32_t cpu_nr_dispatcher
 	ssd->pcie = kmalloc(sizeof(struct ssd_pcie), GFP_KERNEL);
 	ssd_init_pcie(ssd->pcie, spp);
 
+	ssd->compute = kmalloc(sizeof(struct compute_model), GFP_KERNEL);
+	cmodel_init(ssd->compute, spp->nr_cores, spp->core_freq);
+
 	ssd->write_buffer = kmalloc(sizeof(struct buffer), GFP_KERNEL);
 	buffer_init(ssd->write_buffer, spp->write_buffer_size);
 
@@ -325,6 +331,10 @@ void ssd_remove(struct ssd *ssd)
 		kfree(ssd->pcie->perf_model);
 		kfree(ssd->pcie);
 	}
+	if (ssd->compute) {
+		cmodel_remove(ssd->compute);
+		kfree(ssd->compute);
+	}
 
 	for (i = 0; i < ssd->sp.nchs; i++) {
 		ssd_remove_ch(&(ssd->ch[i]));
@@ -339,6 +349,11 @@ uint64_t ssd_advance_pcie(struct ssd *ssd, uint64_t request_time, uint64_t lengt
 	return chmodel_request(perf_model, request_time, length);
 }
 
+uint64_t ssd_advance_compute(struct ssd *ssd, uint64_t request_time, uint64_t cycles)
+{
+	return cmodel_request(ssd->compute, request_time, cycles);
+}
+
 /* Write buffer Performance Model
   Y = A + (B * X)
   Y : latency (ns)
@@ -7,6 +7,7 @@
 #include "pqueue/pqueue.h"
 #include "ssd_config.h"
 #include "channel_model.h"
+#include "compute_model.h"
 /*
     Default malloc size (when sector size is 512B)
     Channel = 40 * 8 = 320
@@ -183,6 +184,9 @@ struct ssdparams {
 	uint64_t ch_bandwidth; /*NAND CH Maximum bandwidth in MiB/s*/
 	uint64_t pcie_bandwidth; /*PCIE Maximum bandwidth in MiB/s*/
 
+	int nr_cores; /* # of controller cores for in-storage processing */
+	uint64_t core_freq; /* controller core frequency in MHz */
+
 	/* below are all calculated values */
 	unsigned long secs_per_blk; /* # of sectors per block */
 	unsigned long secs_per_pl; /* # of sectors per plane */
@@ -216,6 +220,7 @@ struct ssd {
 	struct ssdparams sp;
 	struct ssd_channel *ch;
 	struct ssd_pcie *pcie;
+	struct compute_model *compute;
 	struct buffer *write_buffer;
 	unsigned int cpu_nr_dispatcher;
 };
@@ -261,6 +266,7 @@ void ssd_remove(struct ssd *ssd);
 
 uint64_t ssd_advance_nand(struct ssd *ssd, struct nand_cmd *ncmd);
 uint64_t ssd_advance_pcie(struct ssd *ssd, uint64_t request_time, uint64_t length);
+uint64_t ssd_advance_compute(struct ssd *ssd, uint64_t request_time, uint64_t cycles);
 uint64_t ssd_advance_write_buffer(struct ssd *ssd, uint64_t request_time, uint64_t length);
 uint64_t ssd_next_idle_time(struct ssd *ssd);
 
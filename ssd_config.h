@@ -105,6 +105,32 @@ static_assert((ONESHOT_PAGE_SIZE % FLASH_PAGE_SIZE) == 0);
 #define GLOBAL_WB_SIZE (NAND_CHANNELS * LUNS_PER_NAND_CH * ONESHOT_PAGE_SIZE * 2)
 #define WRITE_EARLY_COMPLETION 1
 
+#define NR_COMPUTE_CORES (2) /* controller cores available for in-storage processing */
+#define COMPUTE_CORE_FREQ (800ull) //MHz
+
+/* cost of the filter operators on a controller core */
+#define FILTER_CYCLES_PER_TUPLE (20) /* record dispatch */
+#define FILTER_CYCLES_PER_BYTE (1) /* streaming the record from DRAM */
+#define FILTER_CYCLES_PER_PRED (4) /* each clause evaluated */
+#define FILTER_CYCLES_PER_AGG (6) /* each aggregate folded */
+#define FILTER_CYCLES_PER_GROUP (60) /* hashing and probing for the group */
+#define FILTER_CYCLES_PER_OUT_BYTE (1) /* copying results out */
+#define FILTER_CYCLES_PER_LIKE_BYTE (1) /* searching a string for a pattern */
+#define FILTER_CYCLES_PER_HEAP (40) /* keeping a record among the top K */
+#define FILTER_CYCLES_PER_PROBE (30) /* hashing a value into a host Bloom filter */
+#define FILTER_CYCLES_PER_PART (20) /* hashing a record to its output partition */
+#define FILTER_CYCLES_PER_LZ4_BYTE (2) /* producing a byte of decompressed LZ4 */
+#define FILTER_CYCLES_PER_DICT_VALUE (2) /* decoding a dictionary-encoded value */
+#define FILTER_CYCLES_PER_SAMPLE (20) /* hashing a record into a row sample */
+#define FILTER_CYCLES_PER_STATS (30) /* folding a value into the statistics of its column */
+#define FILTER_CYCLES_PER_COMPARE (10) /* each comparison sorting a sample of values */
+
+#define FILTER_ARENA_SIZE MB(1) /* controller DRAM for filter operators */
+#define FILTER_BLOOM_MEM_SIZE MB(64) /* controller DRAM for host Bloom filters */
+#define FILTER_MAX_SCAN_SIZE MB(64) /* bytes a streaming filter command scans at most */
+#define FILTER_STATS_SAMPLE_SIZE (4096) /* values sampled per column for histograms */
+#define FILTER_SHARED_SCANS (4) /* recent filter scans later ones can attach to */
+
 #define LBA_BITS (9)
 #define LBA_SIZE (1 << LBA_BITS)
 
@@ -157,6 +183,9 @@ static_assert((ONESHOT_PAGE_SIZE % FLASH_PAGE_SIZE) == 0);
 #define FW_CH_XFER_LATENCY (413)
 #define OP_AREA_PERCENT (0)
 
+#define NR_COMPUTE_CORES (1)
+#define COMPUTE_CORE_FREQ (800ull) //MHz
+
 #define GLOBAL_WB_SIZE (NAND_CHANNELS * LUNS_PER_NAND_CH * ONESHOT_PAGE_SIZE * 2)
 #define ZONE_WB_SIZE (0)
 #define WRITE_EARLY_COMPLETION 0
@@ -222,6 +251,9 @@ static_assert((ONESHOT_PAGE_SIZE % FLASH_PAGE_SIZE) == 0);
 #define FW_CH_XFER_LATENCY (0)
 #define OP_AREA_PERCENT (0)
 
+#define NR_COMPUTE_CORES (1)
+#define COMPUTE_CORE_FREQ (800ull) //MHz
+
 #define ZONE_WB_SIZE (10 * ONESHOT_PAGE_SIZE)
 #define GLOBAL_WB_SIZE (0)
 #define WRITE_EARLY_COMPLETION 1